@@ -0,0 +1,68 @@
+/**
+ * Benchmark of the template matching used in pcb_bestukker.
+ * Compares matchTemplate(TM_CCORR_NORMED) with matchTemplateNcc() for every template on the same board image, and
+ * reports the time per call and the largest difference between the two score maps.
+ * Templates too large for the direct kernel use the matchTemplate() fallback, so both columns should match for them.
+ *
+ * Usage: benchmark_ncc ../pcb_bestukker/input/pcb.jpg ../pcb_bestukker/input --runs=20
+ */
+#include <iostream>
+#include <chrono>
+#include <opencv2/opencv.hpp>
+#include "common/image_io.hpp"
+#include "common/ncc_matching.hpp"
+
+using namespace std;
+using namespace cv;
+
+const String keys("{help h usage ? |<none>| print this message }"
+                  "{@img_pcb       |<none>| board image, e.g. pcb_bestukker/input/pcb.jpg}"
+                  "{@tpl_dir       |<none>| folder containing R.jpg, C.jpg and R_outline.jpg}"
+                  "{runs           |20    | number of calls per template and method}");
+
+/** @return Mean time of one call of match in milliseconds */
+template<typename F>
+double timeMs(int runs, F match)
+{
+    match(); // warm up: allocation of the result, thread pool
+    auto t0 = chrono::steady_clock::now();
+    for(int i = 0; i < runs; i++)
+        match();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / runs;
+}
+
+int main(int argc, char *argv[])
+{
+    CommandLineParser parser(argc, argv, keys);
+    String pathImgPcb = parser.get<String>("@img_pcb");
+    String pathTplDir = parser.get<String>("@tpl_dir");
+    int runs = max(parser.get<int>("runs"), 1);
+    if(!parser.check() || pathImgPcb.empty() || pathTplDir.empty())
+    {
+        parser.printErrors();
+        parser.printMessage();
+        return 1;
+    }
+
+    vector<String> names = {"R.jpg", "C.jpg", "R_outline.jpg"};
+    Mat imgPcb, imgTplR, imgTplC, imgTplROutline;
+    openImgFiles({pathImgPcb, pathTplDir + "/" + names[0], pathTplDir + "/" + names[1], pathTplDir + "/" + names[2]},
+                 {&imgPcb, &imgTplR, &imgTplC, &imgTplROutline});
+    vector<Mat *> templates = {&imgTplR, &imgTplC, &imgTplROutline};
+
+    printf("image: %dx%d, %d channels, threads: %d\n", imgPcb.cols, imgPcb.rows, imgPcb.channels(), getNumThreads());
+    printf("%-14s %8s %8s %14s %14s %8s %10s\n", "template", "size", "kernel", "matchTemplate", "matchTplNcc", "speedup", "max diff");
+    for(size_t i = 0; i < templates.size(); i++)
+    {
+        const Mat &tpl = *templates[i];
+        Mat scoresStock, scoresNcc, diff;
+        double msStock = timeMs(runs, [&]() { matchTemplate(imgPcb, tpl, scoresStock, TM_CCORR_NORMED); });
+        double msNcc = timeMs(runs, [&]() { matchTemplateNcc(imgPcb, tpl, scoresNcc); });
+        absdiff(scoresStock, scoresNcc, diff);
+        double maxDiff;
+        minMaxLoc(diff, nullptr, &maxDiff);
+        printf("%-14s %3dx%-4d %8s %11.2f ms %11.2f ms %7.2fx %10.2g\n", names[i].c_str(), tpl.cols, tpl.rows,
+               nccDirectSupported(imgPcb, tpl) ? "direct" : "dft", msStock, msNcc, msStock / msNcc, maxDiff);
+    }
+    return 0;
+}
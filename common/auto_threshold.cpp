@@ -0,0 +1,188 @@
+#include "common/auto_threshold.hpp"
+#include "common/template_matching.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+
+/** @return The bin that holds the (count / 2)-th sample */
+int histMedian(const std::vector<double> &hist, double count)
+{
+    double seen = 0;
+    for(size_t b = 0; b < hist.size(); b++)
+    {
+        seen += hist[b];
+        if(seen >= count / 2)
+            return (int)b;
+    }
+    return (int)hist.size() - 1;
+}
+
+}
+
+int otsuThreshold(const std::vector<double> &hist)
+{
+    double count = 0, sum = 0;
+    for(size_t b = 0; b < hist.size(); b++)
+    {
+        count += hist[b];
+        sum += b * hist[b];
+    }
+
+    double count0 = 0, sum0 = 0, best = -1;
+    int thr = 0;
+    for(size_t b = 0; b + 1 < hist.size(); b++)
+    {
+        count0 += hist[b];
+        sum0 += b * hist[b];
+        double count1 = count - count0;
+        if(count0 == 0 || count1 == 0)
+            continue;
+        double diff = sum0 / count0 - (sum - sum0) / count1;
+        double between = count0 * count1 * diff * diff;
+        if(between > best)
+        {
+            best = between;
+            thr = (int)b + 1;
+        }
+    }
+    return thr;
+}
+
+int valleyThreshold(const std::vector<double> &hist)
+{
+    int n = (int)hist.size();
+    if(n < 3)
+        return -1;
+    std::vector<double> h(hist), smoothed(n);
+    for(int iteration = 0; iteration < 10000; iteration++)
+    {
+        int peaks[2], numPeaks = 0;
+        for(int b = 1; b < n - 1 && numPeaks <= 2; b++)
+            if(h[b - 1] < h[b] && h[b] >= h[b + 1])
+            {
+                if(numPeaks < 2)
+                    peaks[numPeaks] = b;
+                numPeaks++;
+            }
+
+        if(numPeaks < 2)
+            return -1;
+        if(numPeaks == 2)
+        {
+            // middle of the lowest stretch between the peaks, an empty gap between the modes is often wide
+            double lowest = *std::min_element(h.begin() + peaks[0], h.begin() + peaks[1] + 1);
+            int first = peaks[0], last = peaks[1];
+            while(h[first] > lowest)
+                first++;
+            while(h[last] > lowest)
+                last--;
+            return (first + last) / 2;
+        }
+
+        // 3-bin running mean, the end bins keep their value
+        smoothed[0] = h[0];
+        smoothed[n - 1] = h[n - 1];
+        for(int b = 1; b < n - 1; b++)
+            smoothed[b] = (h[b - 1] + h[b] + h[b + 1]) / 3.0;
+        h.swap(smoothed);
+    }
+    return -1;
+}
+
+int autoGrayThreshold(const cv::Mat &gray)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    std::vector<double> hist(256, 0.0);
+    for(int r = 0; r < gray.rows; r++)
+    {
+        const uchar *p = gray.ptr<uchar>(r);
+        for(int c = 0; c < gray.cols; c++)
+            hist[p[c]]++;
+    }
+    return grayThreshold(hist);
+}
+
+int grayThreshold(const std::vector<double> &hist)
+{
+    int thr = valleyThreshold(hist);
+    return thr >= 0 ? thr : otsuThreshold(hist);
+}
+
+float scoreBackgroundLevel(const std::vector<double> &hist)
+{
+    double count = 0;
+    for(double n : hist)
+        count += n;
+    int median = histMedian(hist, count);
+    std::vector<double> deviations(hist.size(), 0.0);
+    for(int b = 0; b < (int)hist.size(); b++)
+        deviations[std::abs(b - median)] += hist[b];
+    int mad = histMedian(deviations, count);
+    return std::min((float)(median + 3 * 1.4826 * std::max(mad, 1)) / (hist.size() - 1), 0.99f);
+}
+
+float scoreGapThreshold(std::vector<float> scores, float background)
+{
+    std::sort(scores.begin(), scores.end(), std::greater<float>());
+    scores.push_back(background);
+    float thr = background, gap = -1;
+    for(size_t i = 0; i + 1 < scores.size(); i++)
+        if(scores[i] - scores[i + 1] > gap)
+        {
+            gap = scores[i] - scores[i + 1];
+            thr = (scores[i] + scores[i + 1]) / 2;
+        }
+    return thr;
+}
+
+float autoScoreThreshold(const cv::Mat &scoreMap, MatPool *pool)
+{
+    CV_Assert(scoreMap.type() == CV_32FC1);
+    std::vector<double> hist(SCORE_BINS, 0.0);
+    for(int r = 0; r < scoreMap.rows; r++)
+    {
+        const float *p = scoreMap.ptr<float>(r);
+        for(int c = 0; c < scoreMap.cols; c++)
+            hist[std::min(std::max((int)(p[c] * (SCORE_BINS - 1) + 0.5f), 0), SCORE_BINS - 1)]++;
+    }
+
+    float background = scoreBackgroundLevel(hist);
+    std::vector<cv::Point> peaks;
+    std::vector<float> scores;
+    findPeaks(scoreMap, background, peaks, &scores, pool);
+    return scoreGapThreshold(scores, background);
+}
+
+int autoAreaThreshold(const std::vector<int> &sortedAreas)
+{
+    size_t n = sortedAreas.size();
+    if(n < 2)
+        return n ? sortedAreas[0] : 0;
+
+    std::vector<double> logArea(n), prefix(n + 1, 0.0);
+    for(size_t i = 0; i < n; i++)
+    {
+        logArea[i] = std::log(std::max(sortedAreas[i], 1));
+        prefix[i + 1] = prefix[i] + logArea[i];
+    }
+
+    // the data is sorted, so every split point is a candidate threshold and the class means follow from the prefix sums
+    double best = -1;
+    int thr = sortedAreas.back();
+    for(size_t k = 1; k < n; k++)
+    {
+        if(sortedAreas[k] == sortedAreas[k - 1])
+            continue;
+        double mean0 = prefix[k] / k, mean1 = (prefix[n] - prefix[k]) / (n - k);
+        double between = (double)k * (n - k) * (mean0 - mean1) * (mean0 - mean1);
+        if(between > best)
+        {
+            best = between;
+            thr = sortedAreas[k];
+        }
+    }
+    return thr;
+}
@@ -0,0 +1,77 @@
+/**
+ * Automatic threshold selection, so the thresholds of pcb_bestukker no longer have to be tuned with a trackbar.
+ *
+ * Every threshold is derived in one pass from data the pipeline already has: the histogram of the grayscale image,
+ * the score map of a template, or the (sorted) areas of the connected components.
+ */
+#ifndef COMMON_AUTO_THRESHOLD_HPP
+#define COMMON_AUTO_THRESHOLD_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/mat_pool.hpp"
+
+/**
+ * Otsu's method: the threshold that maximises the variance between the two classes of a histogram.
+ * @param hist  Histogram, one count per bin
+ * @return      First bin of the upper class
+ */
+int otsuThreshold(const std::vector<double> &hist);
+
+/**
+ * Valley detection (minimum method): the histogram is smoothed until only two peaks remain, and the threshold is
+ * the lowest bin between them. Unlike Otsu this is not pulled towards the larger class when the classes differ a
+ * lot in size, like the board and the silk screen of a PCB.
+ * @param hist  Histogram, one count per bin
+ * @return      Bin of the valley, -1 if the histogram never becomes bimodal
+ */
+int valleyThreshold(const std::vector<double> &hist);
+
+/**
+ * Threshold of a grayscale image: the valley between its two main modes, or Otsu's threshold if there is no valley.
+ * @param gray  CV_8UC1 image
+ * @return      Threshold between 0 and 255
+ */
+int autoGrayThreshold(const cv::Mat &gray);
+
+/** autoGrayThreshold() on a 256-bin histogram, e.g. summed over the tiles of a large image */
+int grayThreshold(const std::vector<double> &hist);
+
+/** Number of bins of the score histograms of scoreBackgroundLevel(), scores are between 0 and 1 */
+const int SCORE_BINS = 256;
+
+/**
+ * Background level of a score map: median + 3 sigma, with sigma estimated from the median absolute deviation.
+ * @param hist  Histogram of the scores, SCORE_BINS bins from 0 to 1
+ * @return      Only peaks above this level are candidate matches
+ */
+float scoreBackgroundLevel(const std::vector<double> &hist);
+
+/**
+ * Split the candidate peaks of a score map at the largest gap between their scores.
+ * @param scores      Scores of the peaks above the background level
+ * @param background  Background level, closes the list so a map with only true matches keeps them all
+ * @return            Threshold between the two groups
+ */
+float scoreGapThreshold(std::vector<float> scores, float background);
+
+/**
+ * Cutoff for the matches in a template score map (see computeTplScoreMap()).
+ * The median and the median absolute deviation of the scores describe the background, only the peaks well above it
+ * are candidates. The candidate scores are split at the largest gap between them: true matches of a template
+ * score close to each other, clearly apart from the best false match.
+ * @param scoreMap  CV_32FC1 score map with scores between 0 and 1
+ * @param pool      If not null, scratch images are borrowed from this pool
+ * @return          Threshold for findTplMatches(), between 0 and 1
+ */
+float autoScoreThreshold(const cv::Mat &scoreMap, MatPool *pool = nullptr);
+
+/**
+ * Minimum area of the large connected components: the areas are split in two clusters with Otsu's method on the
+ * logarithm of the area, which separates small noise from outlines over several orders of magnitude.
+ * @param sortedAreas  Areas of the components, sorted ascending
+ * @return             Smallest area of the upper cluster, 0 if there are no areas
+ */
+int autoAreaThreshold(const std::vector<int> &sortedAreas);
+
+#endif //COMMON_AUTO_THRESHOLD_HPP
@@ -0,0 +1,191 @@
+/**
+ * HOG+SVM people detection on a batch of frames, parallelised over frames, pyramid levels and windows.
+ *
+ * HOGDescriptor::detectMultiScale() only parallelises over the levels of a single frame, and the largest levels
+ * dominate its run time, so most cores idle while they finish. Here every (frame, level) pair of the batch is
+ * split into horizontal strips of window positions, and all strips are scheduled together, largest first, on
+ * OpenCV's thread pool. Idle threads keep picking up the next strip, so the load stays balanced until the end of
+ * the batch.
+ *
+ * Within a strip, HOGDescriptor::detect() computes the gradient histograms of the strip once and evaluates the
+ * linear SVM on every window with OpenCV's vectorised dot product. Because a strip is an ROI of its level,
+ * detect() reads the real neighbouring pixels instead of a border, so the strips together give exactly the same
+ * windows and scores as running detect() on the whole level.
+ */
+#ifndef COMMON_BATCH_HOG_DETECTOR_HPP
+#define COMMON_BATCH_HOG_DETECTOR_HPP
+
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/image_pyramid.hpp"
+
+class BatchHogDetector
+{
+public:
+    /**
+     * @param hog            HOG descriptor with an SVM detector set, shared read-only by all threads
+     * @param config         Detector settings (scale step, object size, ROI, group threshold)
+     * @param hit_threshold  Threshold on the SVM score of a single window
+     * @param win_stride     Window stride within a level
+     * @param padding        Padding added around each level
+     * @param strip_windows  Number of window rows per strip, strips are at least a window high
+     */
+    BatchHogDetector(const cv::HOGDescriptor &hog, const DetectorConfig &config, double hit_threshold = 0,
+                     cv::Size win_stride = cv::Size(8, 8), cv::Size padding = cv::Size(32, 32), int strip_windows = 16)
+        : hog(hog), config(config), hit_threshold(hit_threshold), win_stride(win_stride), padding(padding),
+          strip_rows(std::max(strip_windows, (hog.winSize.height + win_stride.height - 1) / win_stride.height) * win_stride.height) {}
+
+    /**
+     * Detect people in a batch of frames.
+     * @param frames   Frames of the batch, all the same size
+     * @param objects  Receives the detected people of each frame, in frame coordinates
+     * @param weights  Receives the SVM score of each detection
+     */
+    void detect(const std::vector<cv::Mat> &frames, std::vector<std::vector<cv::Rect> > &objects,
+                std::vector<std::vector<double> > &weights)
+    {
+        no_regions.assign(frames.size(), cv::Rect());
+        detect(frames, no_regions, objects, weights);
+    }
+
+    /**
+     * Detect people in a batch of frames, scanning only a region of each frame.
+     * @param frames   Frames of the batch, all the same size
+     * @param regions  Part of each frame to scan, in frame coordinates (empty = whole frame)
+     * @param objects  Receives the detected people of each frame, in frame coordinates
+     * @param weights  Receives the SVM score of each detection
+     */
+    void detect(const std::vector<cv::Mat> &frames, const std::vector<cv::Rect> &regions,
+                std::vector<std::vector<cv::Rect> > &objects, std::vector<std::vector<double> > &weights)
+    {
+        while(pyramids.size() < frames.size())
+            pyramids.emplace_back(new ImagePyramid(config.scale_factor, config.maxScale(hog.winSize)));
+
+        tasks.clear();
+        for(size_t f = 0; f < frames.size(); f++)
+        {
+            pyramids[f]->setFrame(frames[f]);
+            frame_config = config;
+            if(!regions[f].empty())
+                frame_config.roi = config.roi.empty() ? regions[f] : (config.roi & regions[f]);
+            if(!regions[f].empty() && frame_config.roi.empty())
+                continue;
+            selectDetectorLevels(*pyramids[f], frame_config, hog.winSize, levels);
+            for(const DetectorLevel &l : levels)
+                addStrips((int)f, l);
+        }
+        std::sort(tasks.begin(), tasks.end(), [](const Task &a, const Task &b) { return a.cost() > b.cost(); });
+        if(task_points.size() < tasks.size())
+        {
+            task_points.resize(tasks.size());
+            task_weights.resize(tasks.size());
+        }
+
+        cv::parallel_for_(cv::Range(0, (int)tasks.size()), [this](const cv::Range &range)
+        {
+            for(int t = range.start; t < range.end; t++)
+                runTask(t);
+        }, (double)tasks.size());
+
+        objects.resize(frames.size());
+        weights.resize(frames.size());
+        for(size_t f = 0; f < frames.size(); f++)
+        {
+            objects[f].clear();
+            weights[f].clear();
+        }
+        for(size_t t = 0; t < tasks.size(); t++)
+        {
+            const Task &task = tasks[t];
+            for(size_t i = 0; i < task_points[t].size(); i++)
+            {
+                const cv::Point &pt = task_points[t][i];
+                objects[task.frame].emplace_back(cvRound((pt.x + task.strip.x) / task.scale), cvRound((pt.y + task.strip.y) / task.scale),
+                                                 cvRound(hog.winSize.width / task.scale), cvRound(hog.winSize.height / task.scale));
+                weights[task.frame].push_back(task_weights[t][i]);
+            }
+        }
+        for(size_t f = 0; f < frames.size(); f++)
+        {
+            hog.groupRectangles(objects[f], weights[f], config.group_threshold, 0.2);
+            filterByRoiMask(config, objects[f], weights[f]);
+        }
+    }
+
+private:
+    /** A strip of window positions on one pyramid level of one frame */
+    struct Task
+    {
+        int frame, level;
+        double scale;
+        /// part of the level passed to detect(), in level coordinates
+        cv::Rect strip;
+        /// range of window top rows (strip coordinates) this strip is responsible for
+        int top_lo, top_hi;
+
+        long cost() const { return (long)strip.width * strip.height; }
+    };
+
+    /**
+     * Split the scanned part of a level in strips of strip_rows window top rows.
+     * Each strip also holds the window height below its last top row, so all its windows fit in the strip.
+     */
+    void addStrips(int frame, const DetectorLevel &l)
+    {
+        int num_strips = std::max(1, l.scan.height / strip_rows);
+        for(int k = 0; k < num_strips; k++)
+        {
+            int a = k * strip_rows;
+            int b = (k == num_strips - 1) ? l.scan.height : a + strip_rows;
+            int end = std::min(l.scan.height, b + hog.winSize.height);
+            Task task;
+            task.frame = frame;
+            task.level = l.level;
+            task.scale = l.scale;
+            task.strip = cv::Rect(l.scan.x, l.scan.y + a, l.scan.width, end - a);
+            // the first strip also owns the windows in the top padding, the last one those in the bottom padding
+            task.top_lo = (k == 0) ? INT_MIN : 0;
+            task.top_hi = (k == num_strips - 1) ? INT_MAX : b - a;
+            tasks.push_back(task);
+        }
+    }
+
+    void runTask(int t)
+    {
+        const Task &task = tasks[t];
+        std::vector<cv::Point> &points = task_points[t];
+        std::vector<double> &w = task_weights[t];
+        const cv::Mat &level = pyramids[task.frame]->level(task.level);
+
+        hog.detect(level(task.strip), points, w, hit_threshold, win_stride, padding);
+        size_t kept = 0;
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            if(points[i].y < task.top_lo || points[i].y >= task.top_hi)
+                continue;
+            points[kept] = points[i];
+            w[kept] = w[i];
+            kept++;
+        }
+        points.resize(kept);
+        w.resize(kept);
+    }
+
+    const cv::HOGDescriptor &hog;
+    DetectorConfig config, frame_config;
+    double hit_threshold;
+    cv::Size win_stride, padding;
+    int strip_rows;
+
+    std::vector<std::unique_ptr<ImagePyramid> > pyramids;
+    std::vector<cv::Rect> no_regions;
+    std::vector<DetectorLevel> levels;
+    std::vector<Task> tasks;
+    std::vector<std::vector<cv::Point> > task_points;
+    std::vector<std::vector<double> > task_weights;
+};
+
+#endif //COMMON_BATCH_HOG_DETECTOR_HPP
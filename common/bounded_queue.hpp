@@ -0,0 +1,124 @@
+/**
+ * Bounded, closable FIFO queue for passing work between the stages of a processing pipeline.
+ * push() blocks while the queue is full, which gives natural back-pressure to the producing stage.
+ * pop() blocks while the queue is empty, and returns false once the queue is closed and drained.
+ * Items are stored in a fixed ring buffer, so no memory is allocated after construction.
+ */
+#ifndef COMMON_BOUNDED_QUEUE_HPP
+#define COMMON_BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : slots(capacity > 0 ? capacity : 1), head(0), count(0), closed(false) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Add an item, blocking while the queue is full.
+     * @param item  Item to add
+     * @return      false if the queue was closed (the item is dropped), true otherwise
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || count < slots.size(); });
+        if(closed)
+            return false;
+        slots[(head + count) % slots.size()] = std::move(item);
+        count++;
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Add an item without blocking.
+     * @param item  Item to add
+     * @return      false if the queue is full or closed, true otherwise
+     */
+    bool tryPush(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(closed || count >= slots.size())
+            return false;
+        slots[(head + count) % slots.size()] = std::move(item);
+        count++;
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Remove the oldest item, blocking while the queue is empty.
+     * @param item  Receives the removed item
+     * @return      false if the queue is closed and no items are left, true otherwise
+     */
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || count > 0; });
+        if(count == 0)
+            return false;
+        item = std::move(slots[head]);
+        head = (head + 1) % slots.size();
+        count--;
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Remove the oldest item without blocking.
+     * @param item  Receives the removed item
+     * @return      false if the queue is empty, true otherwise
+     */
+    bool tryPop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(count == 0)
+            return false;
+        item = std::move(slots[head]);
+        head = (head + 1) % slots.size();
+        count--;
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Close the queue: pending and future push() calls fail, pop() keeps returning the remaining items.
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t head, count;
+    bool closed;
+    mutable std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
+
+#endif //COMMON_BOUNDED_QUEUE_HPP
@@ -0,0 +1,216 @@
+/**
+ * Machine-readable output of detection results, shared by all programs.
+ *
+ * Every result is a Detection record: the frame (or image) it belongs to, a class, a score, a bounding box and
+ * optionally a polygon (convex hull, homography corners, rotated match, ...). Records that belong together, like
+ * a designator and its outline on a PCB or the detections of one tracked person, share an id.
+ *
+ * DetectionWriter streams the records to a file as JSON lines or in a compact binary format. Records are formatted
+ * straight into a fixed buffer that is written out when full, so writing a record never allocates and results
+ * can be written at full frame rate.
+ *
+ * JSON lines, one record per line ("id" and "polygon" are left out when not set):
+ *   {"frame":12,"class":"face_haar","id":3,"score":4,"bbox":[10,20,64,64],"polygon":[[10,20],[74,20],...]}
+ *
+ * Binary, all fields in host byte order (little endian on x86/ARM):
+ *   header:  char[4] "DETB", uint32 version (1), uint32 number of classes,
+ *            per class: uint16 name length, name bytes (no terminator)
+ *   record:  int64 frame, int32 class, int32 id, float32 score, int32 x, y, width, height,
+ *            uint32 number of polygon points, per point: float32 x, y
+ */
+#ifndef COMMON_DETECTION_WRITER_HPP
+#define COMMON_DETECTION_WRITER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct Detection
+{
+    /// frame number in a video, 0 for a single image
+    long frame;
+    /// index in the class names passed to DetectionWriter::open()
+    int class_id;
+    /// records with the same id belong together, -1 if not set
+    int id;
+    /// detector score, 0 if the detector has none
+    float score;
+    cv::Rect bbox;
+    /// optional outline of the object, not owned by the record
+    const cv::Point2f *polygon;
+    int num_points;
+
+    Detection(long frame = 0, int class_id = 0, const cv::Rect &bbox = cv::Rect(), float score = 0, int id = -1,
+              const cv::Point2f *polygon = nullptr, int num_points = 0)
+        : frame(frame), class_id(class_id), id(id), score(score), bbox(bbox), polygon(polygon), num_points(num_points) {}
+};
+
+class DetectionWriter
+{
+public:
+    enum Format { FORMAT_JSON, FORMAT_BINARY };
+
+    /**
+     * @param buffer_size  Size of the output buffer in bytes, at least 4 KiB
+     */
+    explicit DetectionWriter(size_t buffer_size = 1 << 16) : file(nullptr), format(FORMAT_JSON), buffer(std::max(buffer_size, (size_t)4096)), used(0) {}
+    ~DetectionWriter() { close(); }
+    DetectionWriter(const DetectionWriter &) = delete;
+    DetectionWriter &operator=(const DetectionWriter &) = delete;
+
+    /** @return FORMAT_BINARY for a .bin file, FORMAT_JSON otherwise */
+    static Format formatFromPath(const std::string &path)
+    {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0 ? FORMAT_BINARY : FORMAT_JSON;
+    }
+
+    /**
+     * Create the output file, an existing file is overwritten.
+     * @param path         Output file
+     * @param class_names  Names of the classes, Detection::class_id indexes this list
+     * @param format       JSON lines or binary
+     * @return             false if the file could not be created
+     */
+    bool open(const std::string &path, const std::vector<std::string> &class_names, Format format)
+    {
+        close();
+        file = fopen(path.c_str(), format == FORMAT_BINARY ? "wb" : "w");
+        if(!file)
+            return false;
+        this->format = format;
+        classes = class_names;
+        if(format == FORMAT_BINARY)
+        {
+            uint32_t version = 1, num_classes = (uint32_t)classes.size();
+            put("DETB", 4);
+            put(&version, sizeof(version));
+            put(&num_classes, sizeof(num_classes));
+            for(const std::string &name : classes)
+            {
+                uint16_t length = (uint16_t)name.size();
+                put(&length, sizeof(length));
+                put(name.data(), length);
+            }
+        }
+        return true;
+    }
+
+    bool open(const std::string &path, const std::vector<std::string> &class_names)
+    {
+        return open(path, class_names, formatFromPath(path));
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    /**
+     * Append a record. Does nothing if no file is open.
+     * @param d  Record to write, class_id must be a valid class index
+     */
+    void write(const Detection &d)
+    {
+        if(!file)
+            return;
+        if(format == FORMAT_BINARY)
+            writeBinary(d);
+        else
+            writeJson(d);
+    }
+
+    /** Write the buffered records to the file */
+    void flush()
+    {
+        if(file && used > 0)
+            fwrite(buffer.data(), 1, used, file);
+        used = 0;
+        if(file)
+            fflush(file);
+    }
+
+    void close()
+    {
+        if(!file)
+            return;
+        flush();
+        fclose(file);
+        file = nullptr;
+    }
+
+private:
+    /** Make room for n bytes in the buffer */
+    void reserve(size_t n)
+    {
+        if(used + n > buffer.size())
+        {
+            fwrite(buffer.data(), 1, used, file);
+            used = 0;
+        }
+    }
+
+    void put(const void *data, size_t n)
+    {
+        if(n > buffer.size())
+        {
+            reserve(buffer.size());
+            fwrite(data, 1, n, file);
+            return;
+        }
+        reserve(n);
+        memcpy(buffer.data() + used, data, n);
+        used += n;
+    }
+
+    void writeBinary(const Detection &d)
+    {
+        int64_t frame = d.frame;
+        int32_t fields[] = {d.class_id, d.id};
+        float score = d.score;
+        int32_t bbox[] = {d.bbox.x, d.bbox.y, d.bbox.width, d.bbox.height};
+        uint32_t num_points = (uint32_t)std::max(d.num_points, 0);
+        put(&frame, sizeof(frame));
+        put(fields, sizeof(fields));
+        put(&score, sizeof(score));
+        put(bbox, sizeof(bbox));
+        put(&num_points, sizeof(num_points));
+        for(uint32_t i = 0; i < num_points; i++)
+        {
+            float xy[] = {d.polygon[i].x, d.polygon[i].y};
+            put(xy, sizeof(xy));
+        }
+    }
+
+    void writeJson(const Detection &d)
+    {
+        // the class name is the only field of unbounded length, everything else fits in a fixed margin
+        const std::string &name = classes[d.class_id];
+        reserve(name.size() + 192);
+        char *out = buffer.data() + used;
+        int n = sprintf(out, "{\"frame\":%ld,\"class\":\"%s\"", d.frame, name.c_str());
+        if(d.id >= 0)
+            n += sprintf(out + n, ",\"id\":%d", d.id);
+        n += sprintf(out + n, ",\"score\":%g,\"bbox\":[%d,%d,%d,%d]", d.score, d.bbox.x, d.bbox.y, d.bbox.width, d.bbox.height);
+        used += n;
+        if(d.num_points > 0)
+        {
+            put(",\"polygon\":[", 12);
+            for(int i = 0; i < d.num_points; i++)
+            {
+                reserve(40);
+                used += sprintf(buffer.data() + used, i ? ",[%g,%g]" : "[%g,%g]", d.polygon[i].x, d.polygon[i].y);
+            }
+            put("]", 1);
+        }
+        put("}\n", 2);
+    }
+
+    FILE *file;
+    Format format;
+    std::vector<std::string> classes;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+#endif //COMMON_DETECTION_WRITER_HPP
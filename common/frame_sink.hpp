@@ -0,0 +1,143 @@
+/**
+ * Output of annotated video frames, so the processing loop does not wait for the display or the encoder.
+ *
+ * - WindowSink shows the frames with imshow() and only polls the keyboard (waitKey(1)), it does not pace the video.
+ * - AsyncVideoSink encodes the frames with a VideoWriter on its own thread. write() copies the frame into one of a
+ *   fixed pool of buffers and returns, so after the first frames nothing is allocated. When all buffers wait for the
+ *   encoder, write() either blocks (every frame is kept) or drops the frame (the video skips frames under load).
+ * - NullSink throws the frames away, for measuring the speed of the detectors alone.
+ */
+#ifndef COMMON_FRAME_SINK_HPP
+#define COMMON_FRAME_SINK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/bounded_queue.hpp"
+
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    /**
+     * Output one frame.
+     * @param frame  Annotated frame, not referenced after the call
+     * @return       false when processing should stop, e.g. a key was pressed in the window
+     */
+    virtual bool write(const cv::Mat &frame) = 0;
+
+    /** Finish the output, waits for the frames that are still queued */
+    virtual void close() {}
+
+    /** @return false if the frames are thrown away, so the caller can skip annotating them */
+    virtual bool needsFrames() const { return true; }
+
+    /** @return Number of frames that were dropped because the output could not keep up */
+    virtual long dropped() const { return 0; }
+};
+
+class NullSink : public FrameSink
+{
+public:
+    bool write(const cv::Mat &) override { return true; }
+    bool needsFrames() const override { return false; }
+};
+
+class WindowSink : public FrameSink
+{
+public:
+    explicit WindowSink(const std::string &name) : name(name) { cv::namedWindow(name); }
+
+    bool write(const cv::Mat &frame) override
+    {
+        cv::imshow(name, frame);
+        return cv::waitKey(1) < 0;
+    }
+
+private:
+    std::string name;
+};
+
+class AsyncVideoSink : public FrameSink
+{
+public:
+    AsyncVideoSink() : skip(false), num_dropped(0) {}
+    ~AsyncVideoSink() override { close(); }
+
+    /**
+     * Create the video file and start the encoder thread.
+     * @param path        Output video (.avi, .mp4, ...)
+     * @param fourcc      Codec, see VideoWriter::fourcc()
+     * @param fps         Frame rate of the video
+     * @param frame_size  Size of the frames
+     * @param queue_size  Number of frame buffers waiting for the encoder
+     * @param skip        Drop frames when all buffers are in use, instead of waiting for the encoder
+     * @return            false if the file could not be created
+     */
+    bool open(const std::string &path, int fourcc, double fps, cv::Size frame_size, int queue_size = 8, bool skip = false)
+    {
+        close();
+        if(!writer.open(path, fourcc, fps > 0 ? fps : 25.0, frame_size))
+            return false;
+        buffers.assign(std::max(queue_size, 1), cv::Mat());
+        free_slots.reset(new BoundedQueue<int>(buffers.size()));
+        full_slots.reset(new BoundedQueue<int>(buffers.size()));
+        for(int i = 0; i < (int)buffers.size(); i++)
+            free_slots->push(i);
+        this->skip = skip;
+        num_dropped = 0;
+        encoder = std::thread([this]()
+        {
+            int slot;
+            while(full_slots->pop(slot))
+            {
+                writer.write(buffers[slot]);
+                free_slots->push(slot);
+            }
+        });
+        return true;
+    }
+
+    bool isOpened() const { return writer.isOpened(); }
+
+    bool write(const cv::Mat &frame) override
+    {
+        CV_Assert(encoder.joinable());
+        int slot;
+        if(skip ? !free_slots->tryPop(slot) : !free_slots->pop(slot))
+        {
+            num_dropped++;
+            return true;
+        }
+        frame.copyTo(buffers[slot]);
+        full_slots->push(slot);
+        return true;
+    }
+
+    void close() override
+    {
+        if(!encoder.joinable())
+            return;
+        full_slots->close();
+        encoder.join();
+        writer.release();
+    }
+
+    long dropped() const override { return num_dropped; }
+
+private:
+    cv::VideoWriter writer;
+    std::vector<cv::Mat> buffers;
+    /// indices of the buffers that are free, resp. wait for the encoder
+    std::unique_ptr<BoundedQueue<int> > free_slots, full_slots;
+    bool skip;
+    std::atomic<long> num_dropped;
+    std::thread encoder;
+};
+
+#endif //COMMON_FRAME_SINK_HPP
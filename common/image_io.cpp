@@ -0,0 +1,56 @@
+#include "common/image_io.hpp"
+#include "common/image_source.hpp"
+#include "common/mat_cache.hpp"
+#include <cstdlib>
+#include <iostream>
+
+void openImgFile(cv::Mat &destination, const cv::String &path, int flags)
+{
+    destination = cv::imread(path, flags);
+    if(destination.empty())
+    {
+        std::cerr << "Could not open " << path << std::endl;
+        exit(2);
+    }
+}
+
+void openImgFiles(const std::vector<cv::String> &paths, const std::vector<cv::Mat *> &destinations, int flags, int reduce,
+                  MatCache *cache)
+{
+    if(paths.size() != destinations.size())
+    {
+        std::cerr << "Error opening input files" << std::endl;
+        exit(1);
+    }
+
+    // only the images that are not cached yet are decoded
+    std::vector<cv::String> decodePaths;
+    std::vector<size_t> decodeIndex;
+    std::vector<std::string> keys(paths.size());
+    for(size_t i = 0; i < paths.size(); i++)
+    {
+        if(cache && cache->enabled())
+            keys[i] = cache->fileKey(paths[i]) + "/imread" + std::to_string(ImageSource::reducedFlags(flags, reduce));
+        if(!cache || !cache->load(keys[i], *destinations[i]))
+        {
+            decodePaths.push_back(paths[i]);
+            decodeIndex.push_back(i);
+        }
+    }
+
+    ImageSource source(decodePaths, flags, reduce, 0, (int)decodePaths.size());
+    size_t d;
+    cv::Mat image;
+    while(source.next(image, &d))
+    {
+        size_t i = decodeIndex[d];
+        if(image.empty())
+        {
+            std::cerr << "Could not open " << paths[i] << std::endl;
+            exit(2);
+        }
+        *destinations[i] = image;
+        if(cache)
+            cache->store(keys[i], image);
+    }
+}
@@ -0,0 +1,33 @@
+/**
+ * Loading of input images, shared by all programs.
+ */
+#ifndef COMMON_IMAGE_IO_HPP
+#define COMMON_IMAGE_IO_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class MatCache;
+
+/**
+ * Helper function for reading in image files.
+ * A message is displayed when the file could not be loaded, and the program is exited through exit().
+ * @param destination OpenCV Mat to receive the image file contents.
+ * @param path        Path to image.
+ * @param flags       cv::ImreadModes flags passed to imread()
+ */
+void openImgFile(cv::Mat &destination, const cv::String &path, int flags = cv::IMREAD_UNCHANGED);
+
+/**
+ * Read a list of image files, decoding them in parallel with an ImageSource.
+ * As with openImgFile(), the program is exited when a file could not be loaded.
+ * @param paths         Paths to the images
+ * @param destinations  Mats to receive the images, one per path
+ * @param flags         cv::ImreadModes flags passed to imread()
+ * @param reduce        Decode at 1/reduce of the resolution (1, 2, 4 or 8), see ImageSource
+ * @param cache         If not null, images found in this cache are mapped instead of decoded, the others are added
+ */
+void openImgFiles(const std::vector<cv::String> &paths, const std::vector<cv::Mat *> &destinations,
+                  int flags = cv::IMREAD_COLOR, int reduce = 1, MatCache *cache = nullptr);
+
+#endif //COMMON_IMAGE_IO_HPP
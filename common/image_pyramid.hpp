@@ -0,0 +1,407 @@
+/**
+ * Shared image pyramid and detector configuration for the sliding window detectors (cascades and HOG).
+ *
+ * OpenCV's detectMultiScale() builds its own pyramid for every call, so running 2 cascades on a frame resizes the
+ * frame twice, and upscaling the frame beforehand (as needed for small objects) makes every level more expensive.
+ * Here the pyramid is built once per frame and shared by all detectors: a level is only computed the first time a
+ * detector asks for it, so upscaled levels only cost something when a detector is configured for small objects.
+ * Each detector evaluates a single scale per level, and the raw detections of all levels are grouped at the end,
+ * just like detectMultiScale() does internally.
+ */
+#ifndef COMMON_IMAGE_PYRAMID_HPP
+#define COMMON_IMAGE_PYRAMID_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Settings for running one detector on an ImagePyramid.
+ */
+struct DetectorConfig
+{
+    DetectorConfig() : scale_factor(1.1), group_threshold(3) {}
+
+    /// Ratio between 2 consecutive scales evaluated by the detector. Rounded to a multiple of the pyramid step.
+    double scale_factor;
+    /// Minimum number of overlapping raw detections to keep an object (minNeighbors, resp. finalThreshold for HOG)
+    int group_threshold;
+    /// Smallest and largest object size in frame pixels. Empty min_size = detector window, empty max_size = no limit.
+    cv::Size min_size, max_size;
+    /// Optional CV_8UC1 mask with the size of the frame. Only objects with their center inside the mask are kept.
+    cv::Mat roi_mask;
+    /// Bounding box of roi_mask, set by setRoiMask(). Detectors only scan this part of each level.
+    cv::Rect roi;
+
+    void setRoiMask(const cv::Mat &mask)
+    {
+        roi_mask = mask;
+        roi = mask.empty() ? cv::Rect() : cv::boundingRect(mask);
+    }
+
+    /**
+     * Largest pyramid scale needed for this detector, i.e. the scale at which min_size matches the detector window.
+     * @param window  Detector window size
+     */
+    double maxScale(cv::Size window) const
+    {
+        if(min_size.empty())
+            return 1.0;
+        return std::min((double)window.width / min_size.width, (double)window.height / min_size.height);
+    }
+
+    /**
+     * Smallest pyramid scale needed for this detector, i.e. the scale at which max_size matches the detector window.
+     * @param window  Detector window size
+     */
+    double minScale(cv::Size window) const
+    {
+        if(max_size.empty())
+            return 0.0;
+        return std::max((double)window.width / max_size.width, (double)window.height / max_size.height);
+    }
+};
+
+/**
+ * Image pyramid with lazily computed levels.
+ * Level i holds the frame scaled by maxScale() / scaleFactor()^i. Levels are only computed when first requested
+ * through level(), which is thread-safe, so several detectors can share the pyramid of a frame concurrently.
+ * The level buffers are kept between frames, so a pyramid that is reused for every frame does not allocate.
+ */
+class ImagePyramid
+{
+public:
+    explicit ImagePyramid(double scale_factor = 1.1, double max_scale = 1.0, bool grayscale = false, int max_levels = 256)
+        : levels(new Level[max_levels]), max_levels(max_levels), num_levels(0), base_built(false)
+    {
+        configure(scale_factor, max_scale, grayscale);
+    }
+
+    ImagePyramid(const ImagePyramid &) = delete;
+    ImagePyramid &operator=(const ImagePyramid &) = delete;
+
+    /**
+     * Change the pyramid geometry. Takes effect at the next setFrame().
+     * @param scale_factor  Ratio between 2 consecutive levels (> 1)
+     * @param max_scale     Scale of level 0 relative to the frame, > 1 means upscaling
+     * @param grayscale     Convert BGR frames to grayscale before building the levels
+     */
+    void configure(double scale_factor, double max_scale, bool grayscale)
+    {
+        this->scale_factor = std::max(scale_factor, 1.0001);
+        this->max_scale = max_scale;
+        this->grayscale = grayscale;
+    }
+
+    /**
+     * Start a new frame. All levels are invalidated, nothing is computed yet.
+     * Not thread-safe: call this before handing the pyramid to the detectors.
+     * @param frame  New frame, referenced (not copied) until the next setFrame()
+     */
+    void setFrame(const cv::Mat &frame)
+    {
+        this->frame = frame;
+        base_built = false;
+        num_levels = 0;
+        while(num_levels < max_levels)
+        {
+            double s = scale(num_levels);
+            if(frame.cols * s < min_level_size || frame.rows * s < min_level_size)
+                break;
+            levels[num_levels].built = false;
+            num_levels++;
+        }
+    }
+
+    int numLevels() const { return num_levels; }
+    double scaleFactor() const { return scale_factor; }
+    double maxScale() const { return max_scale; }
+    cv::Size frameSize() const { return frame.size(); }
+
+    /**
+     * @param i  Level index
+     * @return   Scale of level i relative to the frame
+     */
+    double scale(int i) const { return max_scale / std::pow(scale_factor, i); }
+
+    /**
+     * Get level i, computing it if needed. Thread-safe.
+     * @param i  Level index, 0 <= i < numLevels()
+     * @return   Level image, valid until the next setFrame()
+     */
+    const cv::Mat &level(int i)
+    {
+        Level &l = levels[i];
+        std::lock_guard<std::mutex> lock(l.lock);
+        if(!l.built)
+        {
+            const cv::Mat &b = base();
+            double s = scale(i);
+            if(std::abs(s - 1.0) < 1e-6)
+                l.img = b;
+            else
+                cv::resize(b, l.img, cv::Size(cvRound(b.cols * s), cvRound(b.rows * s)), 0, 0, cv::INTER_LINEAR);
+            l.built = true;
+        }
+        return l.img;
+    }
+
+private:
+    struct Level
+    {
+        Level() : built(false) {}
+        cv::Mat img;
+        bool built;
+        std::mutex lock;
+    };
+
+    /** The frame the levels are computed from, converted to grayscale if requested */
+    const cv::Mat &base()
+    {
+        std::lock_guard<std::mutex> lock(base_lock);
+        if(!base_built)
+        {
+            if(grayscale && frame.channels() == 3)
+                cv::cvtColor(frame, base_img, cv::COLOR_BGR2GRAY);
+            else
+                base_img = frame;
+            base_built = true;
+        }
+        return base_img;
+    }
+
+    static const int min_level_size = 8;
+
+    std::unique_ptr<Level[]> levels;
+    const int max_levels;
+    int num_levels;
+    double scale_factor, max_scale;
+    bool grayscale;
+    cv::Mat frame, base_img;
+    bool base_built;
+    std::mutex base_lock;
+};
+
+/**
+ * A pyramid level selected for a detector, and the part of it the detector should scan.
+ */
+struct DetectorLevel
+{
+    int level;
+    /// scanned rect in level coordinates
+    cv::Rect scan;
+    /// scale of the level relative to the frame
+    double scale;
+};
+
+/**
+ * Select the pyramid levels a detector needs and the part of each level it should scan.
+ * Nothing is computed: the levels themselves are only built when they are requested from the pyramid.
+ * @param pyramid  Pyramid of the frame
+ * @param config   Detector settings
+ * @param window   Detector window size
+ * @param levels   Receives the selected levels, from large to small
+ */
+inline void selectDetectorLevels(const ImagePyramid &pyramid, const DetectorConfig &config, cv::Size window,
+                                 std::vector<DetectorLevel> &levels)
+{
+    double s_max = config.maxScale(window), s_min = config.minScale(window);
+    int stride = std::max(1, (int)std::lround(std::log(config.scale_factor) / std::log(pyramid.scaleFactor())));
+
+    levels.clear();
+    for(int i = 0; i < pyramid.numLevels(); i += stride)
+    {
+        double s = pyramid.scale(i);
+        if(s > s_max * 1.0001)
+            continue;
+        if(s < s_min * 0.9999)
+            break;
+
+        cv::Size level_size(cvRound(pyramid.frameSize().width * s), cvRound(pyramid.frameSize().height * s));
+        if(level_size.width < window.width || level_size.height < window.height)
+            break;
+        cv::Rect scan(cv::Point(0, 0), level_size);
+        if(!config.roi.empty())
+        {
+            // grow the ROI by a window, so objects that are only partially inside it can still be found
+            cv::Rect roi(cvFloor(config.roi.x * s) - window.width, cvFloor(config.roi.y * s) - window.height,
+                         cvCeil(config.roi.width * s) + 2 * window.width, cvCeil(config.roi.height * s) + 2 * window.height);
+            scan &= roi;
+            if(scan.width < window.width || scan.height < window.height)
+                continue;
+        }
+        levels.push_back(DetectorLevel{i, scan, s});
+    }
+}
+
+/**
+ * Run fn on every pyramid level a detector needs, see selectDetectorLevels().
+ * @param fn  Called as fn(level image, scanned rect in level coordinates, level scale) for every selected level
+ */
+template<typename Fn>
+void forEachDetectorLevel(ImagePyramid &pyramid, const DetectorConfig &config, cv::Size window, Fn fn)
+{
+    std::vector<DetectorLevel> levels;
+    selectDetectorLevels(pyramid, config, window, levels);
+    for(const DetectorLevel &l : levels)
+        fn(pyramid.level(l.level)(l.scan), l.scan, l.scale);
+}
+
+/**
+ * Remove the objects whose center is outside config.roi_mask.
+ */
+template<typename W>
+void filterByRoiMask(const DetectorConfig &config, std::vector<cv::Rect> &objects, std::vector<W> &weights)
+{
+    if(config.roi_mask.empty())
+        return;
+    size_t kept = 0;
+    for(size_t i = 0; i < objects.size(); i++)
+    {
+        cv::Point center(objects[i].x + objects[i].width / 2, objects[i].y + objects[i].height / 2);
+        center.x = std::min(std::max(center.x, 0), config.roi_mask.cols - 1);
+        center.y = std::min(std::max(center.y, 0), config.roi_mask.rows - 1);
+        if(config.roi_mask.at<uchar>(center) == 0)
+            continue;
+        objects[kept] = objects[i];
+        weights[kept] = weights[i];
+        kept++;
+    }
+    objects.resize(kept);
+    weights.resize(kept);
+}
+
+/**
+ * Cascade detection on a shared pyramid, equivalent to CascadeClassifier::detectMultiScale().
+ * @param cascade         Cascade classifier, not shared between threads
+ * @param pyramid         Pyramid of the frame (grayscale or BGR)
+ * @param config          Detector settings
+ * @param objects         Detected objects in frame coordinates
+ * @param num_detections  Number of grouped raw detections for each object
+ */
+inline void detectCascade(cv::CascadeClassifier &cascade, ImagePyramid &pyramid, const DetectorConfig &config,
+                          std::vector<cv::Rect> &objects, std::vector<int> &num_detections)
+{
+    cv::Size window = cascade.getOriginalWindowSize();
+    std::vector<cv::Rect> level_objects;
+    std::vector<int> level_num;
+
+    objects.clear();
+    forEachDetectorLevel(pyramid, config, window, [&](const cv::Mat &img, cv::Rect scan, double s)
+    {
+        // min = max = window size: the cascade evaluates exactly 1 scale, minNeighbors = 0: no grouping yet
+        cascade.detectMultiScale(img, level_objects, level_num, 1.1, 0, 0, window, window);
+        for(const cv::Rect &r : level_objects)
+            objects.emplace_back(cvRound((r.x + scan.x) / s), cvRound((r.y + scan.y) / s),
+                                 cvRound(r.width / s), cvRound(r.height / s));
+    });
+    cv::groupRectangles(objects, num_detections, config.group_threshold, 0.2);
+    filterByRoiMask(config, objects, num_detections);
+}
+
+/**
+ * Cascade detection restricted to candidate objects, e.g. the detections of a cheaper cascade.
+ * Every candidate is searched in an ROI enlarged by roi_scale around it, only for objects within size_range of its
+ * size, so only the pyramid levels of that size are scanned and only in a small part of the frame.
+ * @param cascade         Cascade classifier, not shared between threads
+ * @param pyramid         Pyramid of the frame
+ * @param config          Detector settings, roi and the object sizes are narrowed per candidate
+ * @param candidates      Candidate objects in frame coordinates
+ * @param objects         Receives the best detection of every confirmed candidate
+ * @param num_detections  Number of grouped raw detections for each object
+ * @param confirmed       If not null, receives the index of the candidate of each object
+ * @param roi_scale       Size of the searched ROI relative to the candidate
+ * @param size_range      Objects from candidate size / size_range to candidate size * size_range are searched
+ */
+inline void detectCascadeInRegions(cv::CascadeClassifier &cascade, ImagePyramid &pyramid, const DetectorConfig &config,
+                                   const std::vector<cv::Rect> &candidates, std::vector<cv::Rect> &objects,
+                                   std::vector<int> &num_detections, std::vector<int> *confirmed = nullptr,
+                                   double roi_scale = 1.5, double size_range = 1.5)
+{
+    cv::Rect frame_rect(cv::Point(0, 0), pyramid.frameSize());
+    std::vector<cv::Rect> found;
+    std::vector<int> found_num;
+
+    objects.clear();
+    num_detections.clear();
+    if(confirmed)
+        confirmed->clear();
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        const cv::Rect &candidate = candidates[i];
+        cv::Size grow((int)(candidate.width * (roi_scale - 1) / 2), (int)(candidate.height * (roi_scale - 1) / 2));
+        DetectorConfig narrowed = config;
+        narrowed.roi = cv::Rect(candidate.tl() - cv::Point(grow.width, grow.height), candidate.size() + grow + grow) & frame_rect;
+        if(!config.roi.empty())
+            narrowed.roi &= config.roi;
+        if(narrowed.roi.empty())
+            continue;
+        narrowed.min_size = cv::Size((int)(candidate.width / size_range), (int)(candidate.height / size_range));
+        narrowed.max_size = cv::Size((int)(candidate.width * size_range), (int)(candidate.height * size_range));
+
+        detectCascade(cascade, pyramid, narrowed, found, found_num);
+        if(found.empty())
+            continue;
+        size_t best = std::max_element(found_num.begin(), found_num.end()) - found_num.begin();
+        objects.push_back(found[best]);
+        num_detections.push_back(found_num[best]);
+        if(confirmed)
+            confirmed->push_back((int)i);
+    }
+}
+
+/**
+ * HOG+SVM detection on a shared pyramid, equivalent to HOGDescriptor::detectMultiScale().
+ * @param hog            HOG descriptor with an SVM detector set
+ * @param pyramid        Pyramid of the frame
+ * @param config         Detector settings
+ * @param objects        Detected objects in frame coordinates
+ * @param weights        SVM score of each object
+ * @param hit_threshold  Threshold on the SVM score of a single window
+ * @param win_stride     Window stride within a level
+ * @param padding        Padding added around each level
+ */
+inline void detectHog(const cv::HOGDescriptor &hog, ImagePyramid &pyramid, const DetectorConfig &config,
+                      std::vector<cv::Rect> &objects, std::vector<double> &weights, double hit_threshold = 0,
+                      cv::Size win_stride = cv::Size(8, 8), cv::Size padding = cv::Size(32, 32))
+{
+    std::vector<cv::Point> level_points;
+    std::vector<double> level_weights;
+
+    objects.clear();
+    weights.clear();
+    forEachDetectorLevel(pyramid, config, hog.winSize, [&](const cv::Mat &img, cv::Rect scan, double s)
+    {
+        hog.detect(img, level_points, level_weights, hit_threshold, win_stride, padding);
+        for(size_t i = 0; i < level_points.size(); i++)
+        {
+            objects.emplace_back(cvRound((level_points[i].x + scan.x) / s), cvRound((level_points[i].y + scan.y) / s),
+                                 cvRound(hog.winSize.width / s), cvRound(hog.winSize.height / s));
+            weights.push_back(level_weights[i]);
+        }
+    });
+    hog.groupRectangles(objects, weights, config.group_threshold, 0.2);
+    filterByRoiMask(config, objects, weights);
+}
+
+/**
+ * Load an optional ROI mask for DetectorConfig::setRoiMask(), resized to the frame size.
+ * @param path        Path to the mask image (white = detect), empty for no mask
+ * @param frame_size  Size of the video frames
+ * @return            The mask, or an empty Mat if path is empty or the file could not be read
+ */
+inline cv::Mat loadRoiMask(const cv::String &path, cv::Size frame_size)
+{
+    cv::Mat mask;
+    if(path.empty())
+        return mask;
+    mask = cv::imread(path, cv::IMREAD_GRAYSCALE);
+    if(!mask.empty() && mask.size() != frame_size)
+        cv::resize(mask, mask, frame_size, 0, 0, cv::INTER_NEAREST);
+    return mask;
+}
+
+#endif //COMMON_IMAGE_PYRAMID_HPP
@@ -0,0 +1,77 @@
+#include "common/image_source.hpp"
+#include <algorithm>
+#include <utility>
+
+ImageSource::ImageSource(const std::vector<cv::String> &paths, int flags, int reduce, int num_threads, int prefetch)
+    : paths(paths), flags(reducedFlags(flags, reduce)), slots(std::max(prefetch, 1), Slot{cv::Mat(), false}),
+      next_decode(0), next_consume(0), stopping(false)
+{
+    if(num_threads <= 0)
+        num_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    num_threads = std::min({num_threads, (int)paths.size(), (int)slots.size()});
+    for(int t = 0; t < num_threads; t++)
+        threads.emplace_back(&ImageSource::decodeLoop, this);
+}
+
+ImageSource::~ImageSource()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    consumed.notify_all();
+    for(std::thread &thread : threads)
+        thread.join();
+}
+
+int ImageSource::reducedFlags(int flags, int reduce)
+{
+    static const int color[] = {cv::IMREAD_REDUCED_COLOR_2, cv::IMREAD_REDUCED_COLOR_4, cv::IMREAD_REDUCED_COLOR_8};
+    static const int gray[] = {cv::IMREAD_REDUCED_GRAYSCALE_2, cv::IMREAD_REDUCED_GRAYSCALE_4, cv::IMREAD_REDUCED_GRAYSCALE_8};
+    int level = reduce >= 8 ? 2 : reduce >= 4 ? 1 : reduce >= 2 ? 0 : -1;
+    if(level < 0)
+        return flags;
+    if(flags == cv::IMREAD_COLOR)
+        return color[level];
+    if(flags == cv::IMREAD_GRAYSCALE)
+        return gray[level];
+    return flags;
+}
+
+bool ImageSource::next(cv::Mat &image, size_t *index)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if(next_consume >= paths.size())
+        return false;
+    Slot &slot = slots[next_consume % slots.size()];
+    decoded.wait(lock, [&slot] { return slot.ready; });
+    image = std::move(slot.image);
+    slot.image = cv::Mat();
+    slot.ready = false;
+    if(index)
+        *index = next_consume;
+    next_consume++;
+    lock.unlock();
+    consumed.notify_all();
+    return true;
+}
+
+void ImageSource::decodeLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true)
+    {
+        // only decode ahead while there is a free slot for the image
+        consumed.wait(lock, [this] { return stopping || next_decode >= paths.size() || next_decode < next_consume + slots.size(); });
+        if(stopping || next_decode >= paths.size())
+            return;
+        size_t index = next_decode++;
+        lock.unlock();
+        cv::Mat image = cv::imread(paths[index], flags);
+        lock.lock();
+        Slot &slot = slots[index % slots.size()];
+        slot.image = std::move(image);
+        slot.ready = true;
+        decoded.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+/**
+ * Asynchronous, prefetching image loader.
+ *
+ * A pool of decode threads reads the images of a list ahead of the consumer, so JPEG/TIFF decoding overlaps with
+ * processing. At most `prefetch` decoded images wait in a fixed ring of slots: decode threads block when the ring is
+ * full, which bounds memory use, and the consumer receives the images in list order.
+ * When the consumer only needs a reduced resolution, the decoder can downscale while decoding (IMREAD_REDUCED_*),
+ * which for JPEG skips most of the decode work.
+ */
+#ifndef COMMON_IMAGE_SOURCE_HPP
+#define COMMON_IMAGE_SOURCE_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class ImageSource
+{
+public:
+    /**
+     * Start decoding the images in the background.
+     * @param paths        Images to decode, in the order they are returned by next()
+     * @param flags        cv::ImreadModes flags (IMREAD_COLOR, IMREAD_GRAYSCALE or IMREAD_UNCHANGED)
+     * @param reduce       Decode at 1/reduce of the resolution, 1, 2, 4 or 8 (ignored for IMREAD_UNCHANGED)
+     * @param num_threads  Number of decode threads, 0 = number of CPU cores (at most the number of images)
+     * @param prefetch     Maximum number of decoded images waiting for the consumer
+     */
+    explicit ImageSource(const std::vector<cv::String> &paths, int flags = cv::IMREAD_COLOR, int reduce = 1,
+                         int num_threads = 0, int prefetch = 4);
+    ~ImageSource();
+    ImageSource(const ImageSource &) = delete;
+    ImageSource &operator=(const ImageSource &) = delete;
+
+    /**
+     * Get the next image, blocking until it is decoded.
+     * @param image  Receives the image, empty if it could not be read
+     * @param index  If not null, receives the index of the image in paths
+     * @return       false when all images have been returned
+     */
+    bool next(cv::Mat &image, size_t *index = nullptr);
+
+    size_t size() const { return paths.size(); }
+
+    /**
+     * Imread flags for decoding at a reduced resolution.
+     * @param flags   IMREAD_COLOR or IMREAD_GRAYSCALE, other flags are returned unchanged
+     * @param reduce  Reduction factor, 2, 4 or 8 (1 returns flags unchanged)
+     */
+    static int reducedFlags(int flags, int reduce);
+
+private:
+    struct Slot
+    {
+        cv::Mat image;
+        bool ready;
+    };
+
+    void decodeLoop();
+
+    std::vector<cv::String> paths;
+    int flags;
+    std::vector<Slot> slots;
+    size_t next_decode, next_consume;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable decoded, consumed;
+    std::vector<std::thread> threads;
+};
+
+#endif //COMMON_IMAGE_SOURCE_HPP
@@ -0,0 +1,54 @@
+#include "common/image_utils.hpp"
+#include <algorithm>
+#include <cmath>
+
+void rotateImage(const cv::Mat &src, double angle, cv::Mat &dst)
+{
+    cv::Point2f pt(src.cols / 2.f, src.rows / 2.f);
+    cv::Mat r = cv::getRotationMatrix2D(pt, angle, 1.0);
+    cv::warpAffine(src, dst, r, src.size());
+}
+
+void copyToTransparent(cv::Mat &imgDst, const cv::Mat &imgSrc)
+{
+    CV_Assert(imgDst.type() == CV_8UC3 && imgSrc.type() == CV_8UC4 && imgDst.size() == imgSrc.size());
+    for(int r = 0; r < imgDst.rows; r++)
+    {
+        const cv::Vec4b *src = imgSrc.ptr<cv::Vec4b>(r);
+        cv::Vec3b *dst = imgDst.ptr<cv::Vec3b>(r);
+        for(int c = 0; c < imgDst.cols; c++)
+        {
+            if(src[c][3] > 0)
+                dst[c] = cv::Vec3b(src[c][0], src[c][1], src[c][2]);
+        }
+    }
+}
+
+double previewScale(cv::Size size, int maxSide)
+{
+    int side = std::max(size.width, size.height);
+    return side > maxSide && maxSide > 0 ? (double)maxSide / side : 1.0;
+}
+
+int scaledKernelSize(int size, double scale)
+{
+    return std::max(cvRound(size * scale), 1) | 1;
+}
+
+cv::Rect scaleRect(const cv::Rect &rect, double scale)
+{
+    return cv::Rect(cvRound(rect.x * scale), cvRound(rect.y * scale), cvRound(rect.width * scale), cvRound(rect.height * scale));
+}
+
+void downscaleMax(const cv::Mat &src, double scale, cv::Mat &dst)
+{
+    if(scale >= 1.0)
+    {
+        src.copyTo(dst);
+        return;
+    }
+    int k = (int)std::ceil(1.0 / scale);
+    cv::Mat pooled;
+    cv::dilate(src, pooled, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(k, k)));
+    cv::resize(pooled, dst, cv::Size(), scale, scale, cv::INTER_NEAREST);
+}
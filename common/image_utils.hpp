@@ -0,0 +1,54 @@
+/**
+ * Small image manipulation kernels shared by the programs.
+ */
+#ifndef COMMON_IMAGE_UTILS_HPP
+#define COMMON_IMAGE_UTILS_HPP
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Rotate an image around its center, the result keeps the size of the input.
+ * @param src    Image to rotate
+ * @param angle  Rotation angle in degrees (counter-clockwise)
+ * @param dst    Rotated image
+ */
+void rotateImage(const cv::Mat &src, double angle, cv::Mat &dst);
+
+/**
+ * Helper function for copying one image into another, taking into account any transparant pixels.
+ * These pixels are not copied to the destination image.
+ * The images are walked row by row with direct pointers, without splitting off the alpha channel first.
+ * @param imgDst  Destination image (CV_8UC3)
+ * @param imgSrc  Source image with alpha channel (CV_8UC4)
+ * @warn dst and src should have the same dimensions
+ */
+void copyToTransparent(cv::Mat &imgDst, const cv::Mat &imgSrc);
+
+/**
+ * Scale factor of a preview that fits in a square of maxSide pixels, never enlarging.
+ * @param size     Size of the full resolution image
+ * @param maxSide  Maximum width and height of the preview
+ * @return         Scale factor, 1.0 if the image already fits
+ */
+double previewScale(cv::Size size, int maxSide);
+
+/**
+ * Size of a morphology kernel scaled along with the image, rounded to an odd size of at least 1.
+ * @param size   Kernel size at full resolution
+ * @param scale  Scale of the image
+ */
+int scaledKernelSize(int size, double scale);
+
+/** @return rect with all coordinates multiplied by scale */
+cv::Rect scaleRect(const cv::Rect &rect, double scale);
+
+/**
+ * Downscale a response map without losing its peaks: every pixel of the result is the maximum of the pixels it covers,
+ * instead of their mean, so thresholds keep the same meaning on the preview.
+ * @param src    Single channel response map
+ * @param scale  Scale factor, at most 1.0
+ * @param dst    Downscaled map
+ */
+void downscaleMax(const cv::Mat &src, double scale, cv::Mat &dst);
+
+#endif //COMMON_IMAGE_UTILS_HPP
@@ -0,0 +1,191 @@
+#include "common/mat_cache.hpp"
+#include <string>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char MAGIC[4] = {'M', 'A', 'T', 'C'};
+const uint32_t VERSION = 1;
+/// offset of the pixel data is rounded up to this, so the rows of a mapped entry are aligned for SIMD code
+const size_t DATA_ALIGNMENT = 64;
+
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    int32_t rows, cols, type;
+    uint32_t key_length;
+    uint64_t data_offset;
+};
+
+/** 64 bit FNV-1a hash */
+uint64_t fnv1a(const void *data, size_t length, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/** mkdir -p */
+bool createDirectories(const std::string &dir)
+{
+    for(size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1))
+    {
+        std::string part = dir.substr(0, pos);
+        if(mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        if(pos == std::string::npos)
+            return true;
+    }
+}
+
+std::string toHex(uint64_t value)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)value);
+    return hex;
+}
+
+}
+
+MatCache::MatCache(const std::string &dir) : dir(dir)
+{
+    if(!dir.empty() && !createDirectories(dir))
+    {
+        fprintf(stderr, "Cannot create cache directory %s, cache disabled\n", dir.c_str());
+        this->dir.clear();
+    }
+}
+
+MatCache::~MatCache()
+{
+    for(const Mapping &m : mappings)
+        munmap(m.addr, m.length);
+}
+
+std::string MatCache::fileKey(const std::string &path)
+{
+    if(!enabled())
+        return std::string();
+    auto known = file_keys.find(path);
+    if(known != file_keys.end())
+        return known->second;
+
+    std::string key;
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd >= 0 && fstat(fd, &st) == 0)
+    {
+        // the file size is part of the hash, so an empty file also gets a key
+        uint64_t size = (uint64_t)st.st_size;
+        uint64_t hash = fnv1a(&size, sizeof(size));
+        void *data = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        if(data != MAP_FAILED)
+        {
+            hash = fnv1a(data, size, hash);
+            if(data)
+                munmap(data, size);
+            key = toHex(hash);
+        }
+    }
+    if(fd >= 0)
+        close(fd);
+    file_keys[path] = key;
+    return key;
+}
+
+std::string MatCache::entryPath(const std::string &key) const
+{
+    return dir + "/" + toHex(fnv1a(key.data(), key.size())) + ".mat";
+}
+
+bool MatCache::load(const std::string &key, cv::Mat &mat)
+{
+    if(!enabled() || key.empty())
+        return false;
+    int fd = open(entryPath(key).c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    void *addr = MAP_FAILED;
+    size_t length = 0;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header))
+    {
+        length = (size_t)st.st_size;
+        addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(addr == MAP_FAILED)
+        return false;
+
+    // check the header and the full key, the file name is only a hash of the key
+    const Header *header = static_cast<const Header *>(addr);
+    const char *stored_key = static_cast<const char *>(addr) + sizeof(Header);
+    bool valid = memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->version == VERSION &&
+                 header->key_length == key.size() && sizeof(Header) + key.size() <= length &&
+                 memcmp(stored_key, key.data(), key.size()) == 0 && header->rows >= 0 && header->cols >= 0;
+    if(valid)
+    {
+        size_t data_size = (size_t)header->rows * header->cols * CV_ELEM_SIZE(header->type);
+        valid = header->data_offset + data_size <= length;
+    }
+    if(!valid)
+    {
+        munmap(addr, length);
+        return false;
+    }
+    mat = cv::Mat(header->rows, header->cols, header->type, static_cast<char *>(addr) + header->data_offset);
+    mappings.push_back(Mapping{addr, length});
+    return true;
+}
+
+void MatCache::store(const std::string &key, const cv::Mat &mat)
+{
+    if(!enabled() || key.empty() || mat.empty() || mat.dims > 2)
+        return;
+    cv::Mat data = mat.isContinuous() ? mat : mat.clone();
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.rows = data.rows;
+    header.cols = data.cols;
+    header.type = data.type();
+    header.key_length = (uint32_t)key.size();
+    header.data_offset = (sizeof(Header) + key.size() + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+    // write to a temporary file and rename it, so a concurrent run never maps a half written entry
+    std::string path = entryPath(key), tmp = path + ".tmp" + std::to_string(getpid());
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if(!file)
+        return;
+    static const char padding[DATA_ALIGNMENT] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(key.data(), 1, key.size(), file) == key.size() &&
+              fwrite(padding, 1, header.data_offset - sizeof(Header) - key.size(), file) == header.data_offset - sizeof(Header) - key.size() &&
+              fwrite(data.data, 1, data.total() * data.elemSize(), file) == data.total() * data.elemSize();
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0)
+        remove(tmp.c_str());
+}
+
+cv::Mat MatCache::imread(const std::string &path, int flags)
+{
+    cv::Mat image;
+    std::string file_key = fileKey(path);
+    if(file_key.empty())
+        return cv::imread(path, flags);
+    getOrCompute(file_key + "/imread" + std::to_string(flags), image, [&](cv::Mat &m) { m = cv::imread(path, flags); });
+    return image;
+}
@@ -0,0 +1,94 @@
+/**
+ * On-disk cache of decoded images and derived products (grayscale, HSV, template score maps, ...).
+ *
+ * Every entry is keyed by a string that combines the content hash of the input file with the parameters of the
+ * product, so a changed input or parameter never hits a stale entry. Entries are stored as raw, continuous pixel
+ * data behind a small header, and are memory-mapped when loaded: the returned Mat points straight into the mapping,
+ * so a later run skips decoding and conversion and does not even copy the data. Mappings are private (copy on write),
+ * so the program may modify a loaded Mat without changing the cache. They stay valid until the cache is destroyed.
+ *
+ * A cache constructed with an empty directory is disabled: load() always misses and store() does nothing.
+ * A MatCache is not thread-safe.
+ */
+#ifndef COMMON_MAT_CACHE_HPP
+#define COMMON_MAT_CACHE_HPP
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class MatCache
+{
+public:
+    /**
+     * @param dir  Directory holding the cache files, created if needed (empty = cache disabled)
+     */
+    explicit MatCache(const std::string &dir = "");
+    ~MatCache();
+    MatCache(const MatCache &) = delete;
+    MatCache &operator=(const MatCache &) = delete;
+
+    bool enabled() const { return !dir.empty(); }
+
+    /**
+     * Content hash of a file, the base of the keys of everything derived from it. Computed once per path.
+     * @param path  Input file
+     * @return      Hash as hex string, empty if the file cannot be read or the cache is disabled
+     */
+    std::string fileKey(const std::string &path);
+
+    /**
+     * Map a cached entry.
+     * @param key  Key of the entry
+     * @param mat  Receives the entry, pointing into the mapped file
+     * @return     false if the entry is not in the cache
+     */
+    bool load(const std::string &key, cv::Mat &mat);
+
+    /**
+     * Add an entry, an existing entry with the same key is replaced.
+     * @param key  Key of the entry
+     * @param mat  Data to store, any type and number of channels
+     */
+    void store(const std::string &key, const cv::Mat &mat);
+
+    /**
+     * Load an entry, or compute and store it on a miss.
+     * @param key      Key of the entry
+     * @param mat      Receives the entry
+     * @param compute  Called as compute(mat) on a miss
+     */
+    template<typename F>
+    void getOrCompute(const std::string &key, cv::Mat &mat, F compute)
+    {
+        if(load(key, mat))
+            return;
+        compute(mat);
+        store(key, mat);
+    }
+
+    /**
+     * imread() through the cache.
+     * @param path   Image file
+     * @param flags  cv::ImreadModes flags
+     * @return       Decoded image, empty if the file could not be read
+     */
+    cv::Mat imread(const std::string &path, int flags = cv::IMREAD_COLOR);
+
+private:
+    struct Mapping
+    {
+        void *addr;
+        size_t length;
+    };
+
+    std::string entryPath(const std::string &key) const;
+
+    std::string dir;
+    std::map<std::string, std::string> file_keys;
+    std::vector<Mapping> mappings;
+};
+
+#endif //COMMON_MAT_CACHE_HPP
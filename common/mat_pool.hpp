@@ -0,0 +1,92 @@
+/**
+ * Pool of reusable image buffers for the interactive trackbar loops.
+ *
+ * The loops redraw their result every few milliseconds. Cloning the input image or creating fresh masks on every
+ * iteration allocates (and page faults) a full-size buffer each time. A MatPool hands out buffers that are returned
+ * to the pool as soon as the last Mat referring to them is released, so after the first iteration every request is
+ * served from the pool. The allocation counter makes that visible: at steady state it no longer increases.
+ */
+#ifndef COMMON_MAT_POOL_HPP
+#define COMMON_MAT_POOL_HPP
+
+#include <cstdio>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class MatPool
+{
+public:
+    MatPool() : num_allocations(0), num_requests(0) {}
+
+    /**
+     * Borrow a buffer. The buffer is back in the pool when all Mats referring to it are released or reassigned,
+     * so the caller just lets the returned Mat go out of scope. The contents are undefined.
+     * @param size  Size of the buffer
+     * @param type  Type of the buffer, e.g. CV_8UC3
+     * @return      A buffer from the pool, only allocated when no free buffer of this size and type exists
+     */
+    cv::Mat acquire(cv::Size size, int type)
+    {
+        num_requests++;
+        for(const cv::Mat &buffer : buffers)
+            if(buffer.u && buffer.u->refcount == 1 && buffer.size() == size && buffer.type() == type)
+                return buffer;
+        num_allocations++;
+        buffers.emplace_back(size, type);
+        return buffers.back();
+    }
+
+    /** Borrow a buffer holding a copy of src, the replacement of src.clone() */
+    cv::Mat copyOf(const cv::Mat &src)
+    {
+        cv::Mat dst = acquire(src.size(), src.type());
+        src.copyTo(dst);
+        return dst;
+    }
+
+    /** @return Number of buffers allocated by the pool so far */
+    long allocations() const { return num_allocations; }
+    /** @return Number of buffers handed out so far */
+    long requests() const { return num_requests; }
+    /** @return Number of buffers owned by the pool */
+    size_t size() const { return buffers.size(); }
+
+private:
+    std::vector<cv::Mat> buffers;
+    long num_allocations, num_requests;
+};
+
+/**
+ * Allocation counters of an interactive loop: prints how many buffers the pool allocated per iteration,
+ * once when the loop ends.
+ */
+class PoolCounter
+{
+public:
+    PoolCounter(const MatPool &pool, const char *name)
+        : pool(pool), name(name), iterations(0), start(pool.allocations()), first(start), last(start) {}
+
+    /** Call at the end of every iteration */
+    void iteration()
+    {
+        if(++iterations == 1)
+            first = pool.allocations();
+        last = pool.allocations();
+    }
+
+    /** Print the allocations of the first iteration and of all iterations after it */
+    void print() const
+    {
+        if(iterations == 0)
+            return;
+        printf("%s: %ld iterations, %ld buffer allocations in the first, %ld in the %ld after it\n", name, iterations,
+               first - start, last - first, iterations - 1);
+    }
+
+private:
+    const MatPool &pool;
+    const char *name;
+    long iterations, start, first, last;
+};
+
+#endif //COMMON_MAT_POOL_HPP
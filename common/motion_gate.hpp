@@ -0,0 +1,119 @@
+/**
+ * Cheap motion gate to skip detector work on static frames.
+ *
+ * Every frame is downsampled to a small grayscale image and compared with a running average background.
+ * Only when enough pixels differ from the background do the detectors need to run, and then only on the
+ * bounding box of the changed pixels. On static frames the detections of the previous frame are reused.
+ * To recover from missed detections, the detectors still run on the whole frame every max_skip frames.
+ */
+#ifndef COMMON_MOTION_GATE_HPP
+#define COMMON_MOTION_GATE_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class MotionGate
+{
+public:
+    /**
+     * @param min_changed      Minimum fraction of changed pixels for a frame to count as moving
+     * @param pixel_threshold  Minimum absolute difference with the background for a pixel to count as changed
+     * @param work_width       Width of the downsampled image the differences are computed on
+     * @param learning_rate    Update rate of the running average background
+     * @param max_skip         Maximum number of frames in a row that the detectors are skipped
+     */
+    explicit MotionGate(double min_changed = 0.002, int pixel_threshold = 25, int work_width = 160,
+                        double learning_rate = 0.05, int max_skip = 100)
+        : min_changed(min_changed), pixel_threshold(pixel_threshold), work_width(work_width),
+          learning_rate(learning_rate), max_skip(max_skip), since_detect(0), num_skipped(0) {}
+
+    /**
+     * Decide whether the detectors should run on a new frame.
+     * @param frame   New BGR frame
+     * @param region  Receives the part of the frame the detectors should scan (frame coordinates)
+     * @return        false if the frame is static and the previous detections can be reused
+     */
+    bool update(const cv::Mat &frame, cv::Rect &region)
+    {
+        cv::Rect full(0, 0, frame.cols, frame.rows);
+        int work_height = std::max(1, frame.rows * work_width / std::max(frame.cols, 1));
+        if(frame.channels() == 3)
+        {
+            cv::resize(frame, small_bgr, cv::Size(work_width, work_height), 0, 0, cv::INTER_AREA);
+            cv::cvtColor(small_bgr, small, cv::COLOR_BGR2GRAY);
+        }
+        else
+        {
+            cv::resize(frame, small, cv::Size(work_width, work_height), 0, 0, cv::INTER_AREA);
+        }
+
+        if(background.empty() || background.size() != small.size())
+        {
+            small.convertTo(background, CV_32F);
+            since_detect = 0;
+            region = full;
+            return true;
+        }
+
+        background.convertTo(background_8u, CV_8U);
+        cv::absdiff(small, background_8u, diff);
+        cv::threshold(diff, changed, pixel_threshold, 255, cv::THRESH_BINARY);
+        cv::accumulateWeighted(small, background, learning_rate);
+
+        int num_changed = cv::countNonZero(changed);
+        if(num_changed < min_changed * changed.total())
+        {
+            if(++since_detect < max_skip)
+            {
+                num_skipped++;
+                return false;
+            }
+            since_detect = 0;
+            region = full;
+            return true;
+        }
+
+        // bounding box of the changed pixels, grown by a cell and scaled back to the frame
+        since_detect = 0;
+        cv::Rect box = cv::boundingRect(changed);
+        double sx = (double)frame.cols / small.cols, sy = (double)frame.rows / small.rows;
+        region = cv::Rect(cvFloor((box.x - 1) * sx), cvFloor((box.y - 1) * sy),
+                          cvCeil((box.width + 2) * sx), cvCeil((box.height + 2) * sy)) & full;
+        return true;
+    }
+
+    /** @return Number of frames on which the detectors were skipped so far */
+    long skipped() const { return num_skipped; }
+
+private:
+    double min_changed;
+    int pixel_threshold, work_width;
+    double learning_rate;
+    int max_skip, since_detect;
+    long num_skipped;
+    cv::Mat small_bgr, small, background, background_8u, diff, changed;
+};
+
+/**
+ * Complete the detections of a frame that was only scanned in region, with the previous detections outside it.
+ * @param prev         Detections of the previous frame
+ * @param prev_scores  Scores of the previous detections
+ * @param region       Scanned part of the new frame
+ * @param objects      Detections inside region, the previous detections with their center outside it are appended
+ * @param scores       Scores of objects
+ */
+template<typename S>
+void keepOutsideRegion(const std::vector<cv::Rect> &prev, const std::vector<S> &prev_scores, const cv::Rect &region,
+                       std::vector<cv::Rect> &objects, std::vector<S> &scores)
+{
+    for(size_t i = 0; i < prev.size(); i++)
+    {
+        cv::Point center(prev[i].x + prev[i].width / 2, prev[i].y + prev[i].height / 2);
+        if(region.contains(center))
+            continue;
+        objects.push_back(prev[i]);
+        scores.push_back(prev_scores[i]);
+    }
+}
+
+#endif //COMMON_MOTION_GATE_HPP
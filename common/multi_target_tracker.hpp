@@ -0,0 +1,208 @@
+/**
+ * Multi-target tracking-by-detection with IoU matching.
+ *
+ * Every frame, the detections are assigned to the existing tracks with the Hungarian algorithm, using 1 - IoU as
+ * cost. Matched tracks take over the detection, unmatched detections start a new track with a new ID, and tracks
+ * that have not been matched for max_idle frames expire.
+ * The trajectory of each track is kept in a fixed-capacity ring buffer, and expired tracks are recycled, so memory
+ * use and per-frame cost depend only on the number of simultaneously visible targets, not on the length of the video.
+ */
+#ifndef COMMON_MULTI_TARGET_TRACKER_HPP
+#define COMMON_MULTI_TARGET_TRACKER_HPP
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/nms.hpp"
+#include "common/ring_buffer.hpp"
+
+/**
+ * Solve a square assignment problem with the Hungarian algorithm, O(n^3).
+ * The scratch vectors are passed in so repeated calls do not allocate.
+ * @param cost        n x n cost matrix, row major
+ * @param n           Size of the matrix
+ * @param assignment  Receives the assigned column for each row
+ */
+inline void solveAssignment(const std::vector<double> &cost, int n, std::vector<int> &assignment,
+                            std::vector<double> &u, std::vector<double> &v, std::vector<double> &minv,
+                            std::vector<int> &p, std::vector<int> &way, std::vector<char> &used)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    u.assign(n + 1, 0.0);
+    v.assign(n + 1, 0.0);
+    p.assign(n + 1, 0);
+    way.assign(n + 1, 0);
+    for(int i = 1; i <= n; i++)
+    {
+        // add row i, and find an augmenting path from it (1-based, column 0 is a virtual start column)
+        p[0] = i;
+        int j0 = 0;
+        minv.assign(n + 1, inf);
+        used.assign(n + 1, 0);
+        do
+        {
+            used[j0] = 1;
+            int i0 = p[j0], j1 = 0;
+            double delta = inf;
+            for(int j = 1; j <= n; j++)
+            {
+                if(used[j])
+                    continue;
+                double cur = cost[(i0 - 1) * n + (j - 1)] - u[i0] - v[j];
+                if(cur < minv[j])
+                {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if(minv[j] < delta)
+                {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for(int j = 0; j <= n; j++)
+            {
+                if(used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while(p[j0] != 0);
+        do
+        {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while(j0);
+    }
+    assignment.assign(n, -1);
+    for(int j = 1; j <= n; j++)
+    {
+        if(p[j])
+            assignment[p[j] - 1] = j - 1;
+    }
+}
+
+class MultiTargetTracker
+{
+public:
+    struct Track
+    {
+        /// unique ID, never reused
+        long id;
+        /// last matched detection
+        cv::Rect box;
+        /// score of the last matched detection (e.g. the HOG weight), 0 if the detections have no scores
+        double score;
+        /// centers of the last history_length matched detections
+        RingBuffer<cv::Point> history;
+        /// number of frames since the last match
+        int idle;
+        /// false for a recycled slot that holds no track
+        bool alive;
+    };
+
+    /**
+     * @param iou_threshold   Minimum IoU between a track and a detection to match them
+     * @param max_idle        Number of frames a track survives without being matched
+     * @param history_length  Number of trajectory points kept per track
+     */
+    explicit MultiTargetTracker(double iou_threshold = 0.3, int max_idle = 30, size_t history_length = 64)
+        : iou_threshold(iou_threshold), max_idle(max_idle), history_length(history_length), next_id(0) {}
+
+    /**
+     * Update the tracks with the detections of a new frame.
+     * @param detections  Detected objects in the new frame
+     * @param scores      Score of every detection, kept in Track::score; may be empty
+     */
+    void update(const std::vector<cv::Rect> &detections, const std::vector<double> &scores = std::vector<double>())
+    {
+        CV_Assert(scores.empty() || scores.size() == detections.size());
+        live.clear();
+        for(size_t t = 0; t < tracks.size(); t++)
+        {
+            if(tracks[t].alive)
+                live.push_back((int)t);
+        }
+
+        // square cost matrix: live tracks x detections, padded with "no match" cost
+        int n = (int)std::max(live.size(), detections.size());
+        cost.assign((size_t)n * n, 1.0);
+        for(size_t r = 0; r < live.size(); r++)
+        {
+            for(size_t c = 0; c < detections.size(); c++)
+                cost[r * n + c] = 1.0 - intersectionOverUnion(tracks[live[r]].box, detections[c]);
+        }
+        if(n > 0)
+            solveAssignment(cost, n, assignment, u, v, minv, p, way, used);
+
+        matched.assign(detections.size(), 0);
+        for(size_t r = 0; r < live.size(); r++)
+        {
+            Track &track = tracks[live[r]];
+            int c = assignment[r];
+            if(c >= 0 && c < (int)detections.size() && 1.0 - cost[r * n + c] >= iou_threshold)
+            {
+                matched[c] = 1;
+                track.box = detections[c];
+                track.score = scores.empty() ? 0.0 : scores[c];
+                track.history.push(center(detections[c]));
+                track.idle = 0;
+            }
+            else if(++track.idle > max_idle)
+            {
+                track.alive = false;
+            }
+        }
+
+        for(size_t c = 0; c < detections.size(); c++)
+        {
+            if(!matched[c])
+                startTrack(detections[c], scores.empty() ? 0.0 : scores[c]);
+        }
+    }
+
+    /** @return All track slots, check Track::alive before using one */
+    const std::vector<Track> &getTracks() const { return tracks; }
+
+private:
+    static cv::Point center(const cv::Rect &r) { return cv::Point(r.x + r.width / 2, r.y + r.height / 2); }
+
+    void startTrack(const cv::Rect &box, double score)
+    {
+        // recycle an expired slot if there is one, so its history buffer is reused
+        auto slot = std::find_if(tracks.begin(), tracks.end(), [](const Track &t) { return !t.alive; });
+        if(slot == tracks.end())
+        {
+            tracks.push_back(Track{0, cv::Rect(), 0.0, RingBuffer<cv::Point>(history_length), 0, false});
+            slot = tracks.end() - 1;
+        }
+        slot->id = next_id++;
+        slot->box = box;
+        slot->score = score;
+        slot->history.clear();
+        slot->history.push(center(box));
+        slot->idle = 0;
+        slot->alive = true;
+    }
+
+    double iou_threshold;
+    int max_idle;
+    size_t history_length;
+    long next_id;
+    std::vector<Track> tracks;
+
+    // scratch buffers, kept between frames
+    std::vector<int> live, assignment, p, way;
+    std::vector<char> matched, used;
+    std::vector<double> cost, u, v, minv;
+};
+
+#endif //COMMON_MULTI_TARGET_TRACKER_HPP
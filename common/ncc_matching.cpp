@@ -0,0 +1,167 @@
+#include "common/ncc_matching.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+/** Largest template (width x height x channels) for the direct kernel */
+const int MAX_DIRECT_ELEMENTS = 4096;
+/** Template widths up to this value have a compile-time specialised kernel */
+const int MAX_SPECIALIZED_WIDTH = 32;
+/** Size of an output tile, one row of a tile is accumulated in registers / L1 */
+const int TILE_ROWS = 16, TILE_COLS = 64;
+
+/**
+ * Compute the scores of one output tile.
+ * Every template pixel is broadcast and multiplied with a contiguous run of TILE_COLS image pixels, which the compiler
+ * turns into vector multiply-adds. TW is the template width, 0 if it is only known at run time.
+ * @param planes      Channels of the image as CV_32FC1, padded with TILE_COLS columns so a tile never reads past a row
+ * @param tplPlanes   Channels of the template as CV_32FC1
+ * @param sqIntegral  Integral image of the squared pixels, summed over the channels (CV_64FC1)
+ * @param tplNorm     Square root of the sum of the squared template pixels
+ */
+template<int TW>
+void correlateTile(const std::vector<cv::Mat> &planes, const std::vector<cv::Mat> &tplPlanes, const cv::Mat &sqIntegral,
+                   double tplNorm, cv::Mat &result, const cv::Rect &tile)
+{
+    const int tplRows = tplPlanes[0].rows, tplCols = TW > 0 ? TW : tplPlanes[0].cols;
+    float acc[TILE_COLS];
+    for(int y = tile.y; y < tile.y + tile.height; y++)
+    {
+        std::fill(acc, acc + TILE_COLS, 0.0f);
+        for(size_t c = 0; c < planes.size(); c++)
+            for(int ty = 0; ty < tplRows; ty++)
+            {
+                const float *row = planes[c].ptr<float>(y + ty) + tile.x, *t = tplPlanes[c].ptr<float>(ty);
+                for(int tx = 0; tx < tplCols; tx++)
+                {
+                    const float w = t[tx], *p = row + tx;
+                    for(int x = 0; x < TILE_COLS; x++)
+                        acc[x] += w * p[x];
+                }
+            }
+
+        float *out = result.ptr<float>(y);
+        const double *sqTop = sqIntegral.ptr<double>(y), *sqBottom = sqIntegral.ptr<double>(y + tplRows);
+        for(int x = tile.x; x < tile.x + tile.width; x++)
+        {
+            double windowSq = sqBottom[x + tplCols] - sqBottom[x] - sqTop[x + tplCols] + sqTop[x];
+            double denom = tplNorm * std::sqrt(std::max(windowSq, 0.0));
+            out[x] = denom > DBL_EPSILON ? (float)std::min(acc[x - tile.x] / denom, 1.0) : 0.0f;
+        }
+    }
+}
+
+typedef void (*TileKernel)(const std::vector<cv::Mat> &, const std::vector<cv::Mat> &, const cv::Mat &, double, cv::Mat &,
+                           const cv::Rect &);
+
+/** Fills table[0..N] with the kernels specialised for template width 0 (run time) to N */
+template<int N>
+struct KernelTable
+{
+    static void fill(TileKernel *table)
+    {
+        table[N] = correlateTile<N>;
+        KernelTable<N - 1>::fill(table);
+    }
+};
+
+template<>
+struct KernelTable<0>
+{
+    static void fill(TileKernel *table) { table[0] = correlateTile<0>; }
+};
+
+TileKernel tileKernel(int tplWidth)
+{
+    static TileKernel table[MAX_SPECIALIZED_WIDTH + 1];
+    static bool filled = (KernelTable<MAX_SPECIALIZED_WIDTH>::fill(table), true);
+    (void)filled;
+    return table[tplWidth <= MAX_SPECIALIZED_WIDTH ? tplWidth : 0];
+}
+
+/** Split an 8-bit image in CV_32FC1 channels, each padded with pad zero columns on the right */
+void splitPlanes(const cv::Mat &img, int pad, std::vector<cv::Mat> &planes)
+{
+    int cn = img.channels();
+    planes.resize(cn);
+    for(int c = 0; c < cn; c++)
+        planes[c].create(img.rows, img.cols + pad, CV_32FC1);
+    for(int y = 0; y < img.rows; y++)
+    {
+        const uchar *p = img.ptr<uchar>(y);
+        for(int c = 0; c < cn; c++)
+        {
+            float *dst = planes[c].ptr<float>(y);
+            for(int x = 0; x < img.cols; x++)
+                dst[x] = p[x * cn + c];
+            std::fill(dst + img.cols, dst + img.cols + pad, 0.0f);
+        }
+    }
+}
+
+/** Integral image of the squared pixels, summed over the channels */
+void squaredIntegral(const cv::Mat &img, cv::Mat &sqIntegral)
+{
+    int rowLength = img.cols * img.channels(), cn = img.channels();
+    sqIntegral.create(img.rows + 1, img.cols + 1, CV_64FC1);
+    std::fill(sqIntegral.ptr<double>(0), sqIntegral.ptr<double>(0) + img.cols + 1, 0.0);
+    for(int y = 0; y < img.rows; y++)
+    {
+        const uchar *p = img.ptr<uchar>(y);
+        const double *above = sqIntegral.ptr<double>(y);
+        double *row = sqIntegral.ptr<double>(y + 1);
+        double rowSum = 0;
+        row[0] = 0;
+        for(int i = 0; i < rowLength; i++)
+        {
+            rowSum += p[i] * p[i];
+            if(i % cn == cn - 1)
+                row[i / cn + 1] = above[i / cn + 1] + rowSum;
+        }
+    }
+}
+
+}
+
+bool nccDirectSupported(const cv::Mat &img, const cv::Mat &tpl)
+{
+    return !img.empty() && !tpl.empty() && img.depth() == CV_8U && img.type() == tpl.type() && img.channels() <= 4 &&
+           (int)tpl.total() * tpl.channels() <= MAX_DIRECT_ELEMENTS && tpl.rows <= img.rows && tpl.cols <= img.cols;
+}
+
+void matchTemplateNcc(const cv::Mat &img, const cv::Mat &tpl, cv::Mat &result)
+{
+    if(!nccDirectSupported(img, tpl))
+    {
+        cv::matchTemplate(img, tpl, result, cv::TM_CCORR_NORMED);
+        return;
+    }
+
+    cv::Mat sqIntegral;
+    std::vector<cv::Mat> planes, tplPlanes;
+    squaredIntegral(img, sqIntegral);
+    splitPlanes(img, TILE_COLS, planes);
+    splitPlanes(tpl, 0, tplPlanes);
+    double tplSq = 0;
+    for(const cv::Mat &plane : tplPlanes)
+        for(int y = 0; y < plane.rows; y++)
+            for(int x = 0; x < plane.cols; x++)
+                tplSq += (double)plane.ptr<float>(y)[x] * plane.ptr<float>(y)[x];
+    double tplNorm = std::sqrt(tplSq);
+
+    result.create(img.rows - tpl.rows + 1, img.cols - tpl.cols + 1, CV_32FC1);
+    TileKernel kernel = tileKernel(tpl.cols);
+    int tilesX = (result.cols + TILE_COLS - 1) / TILE_COLS, tilesY = (result.rows + TILE_ROWS - 1) / TILE_ROWS;
+    cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range &range)
+    {
+        for(int t = range.start; t < range.end; t++)
+        {
+            cv::Rect tile((t % tilesX) * TILE_COLS, (t / tilesX) * TILE_ROWS, TILE_COLS, TILE_ROWS);
+            kernel(planes, tplPlanes, sqIntegral, tplNorm, result, tile & cv::Rect(0, 0, result.cols, result.rows));
+        }
+    });
+}
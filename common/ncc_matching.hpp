@@ -0,0 +1,30 @@
+/**
+ * Normalised cross correlation specialised for small 8-bit templates, like the designator templates of pcb_bestukker.
+ *
+ * matchTemplate() decides between a DFT and a direct path for generic sizes. For a template of a few hundred pixels on
+ * a full board, correlating directly is cheaper than the DFT, provided the inner loop is tight: the row length of the
+ * template (width x channels) is a compile-time constant for common sizes, so the compiler unrolls and vectorises the
+ * 8-bit dot products. The output is computed in tiles, so the image rows a tile reads stay in the cache, and the
+ * tiles are spread over the OpenCV thread pool. The normalisation term of every position comes from an integral
+ * image of the squared pixels, instead of being summed per position.
+ * Larger templates fall back to matchTemplate(), which uses the DFT for them.
+ */
+#ifndef COMMON_NCC_MATCHING_HPP
+#define COMMON_NCC_MATCHING_HPP
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @return true if matchTemplateNcc() correlates img and tpl with the direct kernel instead of the DFT fallback
+ */
+bool nccDirectSupported(const cv::Mat &img, const cv::Mat &tpl);
+
+/**
+ * Drop-in replacement of matchTemplate(img, tpl, result, TM_CCORR_NORMED).
+ * @param img     Image to search, 8-bit with 1 to 4 channels for the direct kernel
+ * @param tpl     Template of the same type as img
+ * @param result  Receives the score of each template position (CV_32FC1)
+ */
+void matchTemplateNcc(const cv::Mat &img, const cv::Mat &tpl, cv::Mat &result);
+
+#endif //COMMON_NCC_MATCHING_HPP
@@ -0,0 +1,103 @@
+#include "common/nms.hpp"
+#include <algorithm>
+#include <numeric>
+
+float intersectionOverUnion(const cv::Rect &a, const cv::Rect &b)
+{
+    int intersection = (a & b).area();
+    if(intersection <= 0)
+        return 0.0f;
+    return (float)intersection / (float)(a.area() + b.area() - intersection);
+}
+
+void nonMaximumSuppression(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores, float iouThr,
+                           std::vector<int> &keep, std::vector<cv::Rect> *merged)
+{
+    CV_Assert(boxes.size() == scores.size());
+    keep.clear();
+    if(merged)
+        merged->clear();
+    if(boxes.empty())
+        return;
+
+    // grid cells of the mean box size: two overlapping boxes share at least one cell, and a box covers few cells
+    cv::Rect bounds = boxes[0];
+    double meanSide = 0;
+    for(const cv::Rect &box : boxes)
+    {
+        bounds |= box;
+        meanSide += std::max(box.width, box.height);
+    }
+    int cell = std::max((int)(meanSide / boxes.size()), 1);
+    int gridCols = bounds.width / cell + 1, gridRows = bounds.height / cell + 1;
+    auto cellRange = [&](const cv::Rect &box, int &c0, int &r0, int &c1, int &r1)
+    {
+        c0 = (box.x - bounds.x) / cell;
+        r0 = (box.y - bounds.y) / cell;
+        c1 = (box.x + std::max(box.width, 1) - 1 - bounds.x) / cell;
+        r1 = (box.y + std::max(box.height, 1) - 1 - bounds.y) / cell;
+    };
+
+    // cells as linked lists in one array: first box per cell, next box per entry
+    std::vector<int> first(gridCols * gridRows, -1), next, entryBox;
+    for(int i = 0; i < (int)boxes.size(); i++)
+    {
+        int c0, r0, c1, r1;
+        cellRange(boxes[i], c0, r0, c1, r1);
+        for(int r = r0; r <= r1; r++)
+            for(int c = c0; c <= c1; c++)
+            {
+                next.push_back(first[r * gridCols + c]);
+                entryBox.push_back(i);
+                first[r * gridCols + c] = (int)entryBox.size() - 1;
+            }
+    }
+
+    std::vector<int> order(boxes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return scores[a] > scores[b]; });
+
+    // suppressed[i]: box i is gone; visited[i] == k: box i was already compared with the k-th kept box
+    std::vector<char> suppressed(boxes.size(), 0);
+    std::vector<int> visited(boxes.size(), -1);
+    for(int i : order)
+    {
+        if(suppressed[i])
+            continue;
+        suppressed[i] = 1;
+        int k = (int)keep.size();
+        keep.push_back(i);
+        const cv::Rect &best = boxes[i];
+        double weight = scores[i], x0 = weight * best.x, y0 = weight * best.y;
+        double x1 = weight * best.br().x, y1 = weight * best.br().y;
+
+        int c0, r0, c1, r1;
+        cellRange(best, c0, r0, c1, r1);
+        for(int r = r0; r <= r1; r++)
+            for(int c = c0; c <= c1; c++)
+                for(int e = first[r * gridCols + c]; e >= 0; e = next[e])
+                {
+                    int j = entryBox[e];
+                    if(suppressed[j] || visited[j] == k)
+                        continue;
+                    visited[j] = k;
+                    if(intersectionOverUnion(best, boxes[j]) <= iouThr)
+                        continue;
+                    suppressed[j] = 1;
+                    const cv::Rect &box = boxes[j];
+                    weight += scores[j];
+                    x0 += scores[j] * box.x;
+                    y0 += scores[j] * box.y;
+                    x1 += scores[j] * box.br().x;
+                    y1 += scores[j] * box.br().y;
+                }
+        if(merged)
+        {
+            if(weight > 0)
+                merged->push_back(cv::Rect(cv::Point(cvRound(x0 / weight), cvRound(y0 / weight)),
+                                           cv::Point(cvRound(x1 / weight), cvRound(y1 / weight))));
+            else
+                merged->push_back(best);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+/**
+ * Non-maximum suppression of overlapping detections, shared by sessie_3 and sessie_6.
+ *
+ * Detectors that respond at every position near an object (template matching above a threshold, cascades of two
+ * different models) report many boxes per object. Greedy NMS keeps the best scoring box and suppresses every box
+ * that overlaps it too much, then continues with the best remaining box. The boxes are indexed in a uniform grid, so
+ * a kept box is only compared with the boxes in the cells it covers instead of with all boxes.
+ */
+#ifndef COMMON_NMS_HPP
+#define COMMON_NMS_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/** @return Intersection over union of two boxes, 0 if they do not overlap */
+float intersectionOverUnion(const cv::Rect &a, const cv::Rect &b);
+
+/**
+ * Greedy non-maximum suppression.
+ * @param boxes   Candidate boxes
+ * @param scores  Score of every box, higher is better
+ * @param iouThr  A box is suppressed when its intersection over union with a kept box is above this value
+ * @param keep    Receives the indices of the kept boxes, best score first
+ * @param merged  If not null, receives for every kept box the score-weighted mean of the box and the boxes it
+ *                suppressed, which is more stable than the single best box
+ */
+void nonMaximumSuppression(const std::vector<cv::Rect> &boxes, const std::vector<float> &scores, float iouThr,
+                           std::vector<int> &keep, std::vector<cv::Rect> *merged = nullptr);
+
+#endif //COMMON_NMS_HPP
@@ -0,0 +1,197 @@
+#include "common/panel.hpp"
+#include "common/image_utils.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+/** The autocorrelation first drops below this value before a repeat is searched */
+const double DECORRELATED = 0.25;
+/** Minimum autocorrelation of a repeat */
+const double MIN_PERIODICITY = 0.5;
+/** Multiples of the pitch correlate about as well as the pitch itself, the first peak within this fraction wins */
+const double HARMONIC_TOLERANCE = 0.85;
+/** Size of the registration patch at full resolution */
+const int PATCH_SIZE = 128;
+
+/**
+ * Autocorrelation of an image along its rows and columns, normalised by the overlap so that a shift by a full repeat
+ * scores close to 1 however small the overlap.
+ * @param gray     Zero-mean CV_32FC1 image
+ * @param rowProf  Receives the correlation of a horizontal shift by 0..cols-1
+ * @param colProf  Receives the correlation of a vertical shift by 0..rows-1
+ */
+void autocorrelation(const cv::Mat &gray, std::vector<double> &rowProf, std::vector<double> &colProf)
+{
+    // padded to twice the size so the correlation of the DFT does not wrap around
+    cv::Mat padded = cv::Mat::zeros(cv::getOptimalDFTSize(2 * gray.rows), cv::getOptimalDFTSize(2 * gray.cols), CV_32FC1);
+    gray.copyTo(padded(cv::Rect(0, 0, gray.cols, gray.rows)));
+    cv::Mat spectrum, power, corr;
+    cv::dft(padded, spectrum);
+    cv::mulSpectrums(spectrum, spectrum, power, 0, true);
+    cv::dft(power, corr, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+
+    double zero = corr.at<float>(0, 0) / gray.total();
+    rowProf.assign(gray.cols, 0.0);
+    colProf.assign(gray.rows, 0.0);
+    if(zero <= 0)
+        return;
+    for(int dx = 0; dx < gray.cols; dx++)
+        rowProf[dx] = corr.at<float>(0, dx) / ((double)(gray.cols - dx) * gray.rows) / zero;
+    for(int dy = 0; dy < gray.rows; dy++)
+        colProf[dy] = corr.at<float>(dy, 0) / ((double)(gray.rows - dy) * gray.cols) / zero;
+}
+
+/**
+ * Repeat pitch from an autocorrelation profile: the first local maximum that is about as high as the highest one.
+ * Only shifts up to two thirds of the profile are considered, the overlap of larger shifts is too small.
+ * @return  Pitch in pixels, 0 if the profile does not repeat
+ */
+int repeatPitch(const std::vector<double> &profile)
+{
+    int maxShift = (int)profile.size() * 2 / 3, start = 1;
+    while(start < maxShift && profile[start] >= DECORRELATED)
+        start++;
+    if(start + 1 >= maxShift)
+        return 0;
+    double best = *std::max_element(profile.begin() + start, profile.begin() + maxShift);
+    if(best < MIN_PERIODICITY)
+        return 0;
+    for(int dx = start + 1; dx < maxShift - 1; dx++)
+        if(profile[dx] >= HARMONIC_TOLERANCE * best && profile[dx] >= profile[dx - 1] && profile[dx] >= profile[dx + 1])
+            return dx;
+    return (int)(std::max_element(profile.begin() + start, profile.begin() + maxShift) - profile.begin());
+}
+
+/** @return The patch of the board on a 3x3 grid of positions with the most contrast, uniform areas register badly */
+cv::Rect texturedPatch(const cv::Mat &img, const cv::Rect &board)
+{
+    cv::Size size(std::min(PATCH_SIZE, board.width), std::min(PATCH_SIZE, board.height));
+    cv::Rect best(board.tl(), size);
+    double bestContrast = -1;
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+        {
+            cv::Rect patch(board.x + (board.width - size.width) * j / 2, board.y + (board.height - size.height) * i / 2,
+                           size.width, size.height);
+            cv::Scalar mean, stddev;
+            cv::meanStdDev(img(patch), mean, stddev);
+            double contrast = stddev[0] + stddev[1] + stddev[2] + stddev[3];
+            if(contrast > bestContrast)
+            {
+                bestContrast = contrast;
+                best = patch;
+            }
+        }
+    return best;
+}
+
+/**
+ * Search the patch near a predicted position.
+ * @param found  Receives the best position of the top-left corner of the patch
+ * @return       Score of the best position, -1 if the search window is not in the image
+ */
+float registerPatch(const cv::Mat &img, const cv::Rect &patch, cv::Point predicted, int radius, cv::Point &found)
+{
+    cv::Rect window(predicted.x - radius, predicted.y - radius, patch.width + 2 * radius, patch.height + 2 * radius);
+    window &= cv::Rect(0, 0, img.cols, img.rows);
+    if(window.width < patch.width || window.height < patch.height)
+        return -1;
+    cv::Mat result;
+    cv::matchTemplate(img(window), img(patch), result, cv::TM_CCOEFF_NORMED);
+    double score;
+    cv::Point loc;
+    cv::minMaxLoc(result, nullptr, &score, nullptr, &loc);
+    found = window.tl() + loc;
+    return (float)score;
+}
+
+}
+
+PanelLayout findPanelLayout(const cv::Mat &img, int maxPreview, float minScore)
+{
+    cv::Rect image(0, 0, img.cols, img.rows);
+    PanelLayout layout;
+    layout.pitch = img.size();
+    layout.boards.push_back(image);
+    layout.scores.push_back(1.0f);
+
+    double scale = previewScale(img.size(), maxPreview);
+    cv::Mat preview = img, gray;
+    if(scale < 1.0)
+        cv::resize(img, preview, cv::Size(), scale, scale, cv::INTER_AREA);
+    if(preview.channels() == 1)
+        preview.convertTo(gray, CV_32F);
+    else
+    {
+        cv::cvtColor(preview, gray, preview.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        gray.convertTo(gray, CV_32F);
+    }
+    gray -= cv::mean(gray);
+
+    std::vector<double> rowProf, colProf;
+    autocorrelation(gray, rowProf, colProf);
+    int px = repeatPitch(rowProf), py = repeatPitch(colProf);
+    if(px == 0 && py == 0)
+        return layout;
+
+    // the grid is centred on the image, the margins outside it are panel rails
+    cv::Size pitch(px > 0 ? cvRound(px / scale) : img.cols, py > 0 ? cvRound(py / scale) : img.rows);
+    int nx = std::max(img.cols / pitch.width, 1), ny = std::max(img.rows / pitch.height, 1);
+    cv::Point origin((img.cols - nx * pitch.width) / 2, (img.rows - ny * pitch.height) / 2);
+    int refRow = ny / 2, refCol = nx / 2;
+    cv::Rect reference(origin + cv::Point(refCol * pitch.width, refRow * pitch.height), pitch);
+    cv::Rect patch = texturedPatch(img, reference);
+    // the pitch of the preview is accurate to a preview pixel
+    int radius = (int)std::ceil(1.0 / scale) + 2;
+
+    // refine the pitch with the neighbouring boards, so the error does not add up over the grid
+    cv::Point found;
+    if(nx > 1)
+    {
+        int step = refCol + 1 < nx ? 1 : -1;
+        if(registerPatch(img, patch, patch.tl() + cv::Point(step * pitch.width, 0), radius, found) >= minScore)
+            pitch.width = std::abs(found.x - patch.x);
+    }
+    if(ny > 1)
+    {
+        int step = refRow + 1 < ny ? 1 : -1;
+        if(registerPatch(img, patch, patch.tl() + cv::Point(0, step * pitch.height), radius, found) >= minScore)
+            pitch.height = std::abs(found.y - patch.y);
+    }
+    layout.pitch = pitch;
+    layout.boards.clear();
+    layout.scores.clear();
+
+    for(int r = 0; r < ny; r++)
+        for(int c = 0; c < nx; c++)
+        {
+            if(r == refRow && c == refCol)
+            {
+                layout.reference = (int)layout.boards.size();
+                layout.boards.push_back(reference);
+                layout.scores.push_back(1.0f);
+                continue;
+            }
+            cv::Point predicted = patch.tl() + cv::Point((c - refCol) * pitch.width, (r - refRow) * pitch.height);
+            float score = registerPatch(img, patch, predicted, radius, found);
+            cv::Rect board(reference.tl() + (found - patch.tl()), reference.size());
+            if(score < minScore || (board & image) != board)
+            {
+                layout.rejected++;
+                continue;
+            }
+            layout.boards.push_back(board);
+            layout.scores.push_back(score);
+        }
+    return layout;
+}
+
+float patchSimilarity(const cv::Mat &a, const cv::Mat &b)
+{
+    CV_Assert(a.size() == b.size() && a.type() == b.type());
+    cv::Mat result;
+    cv::matchTemplate(a, b, result, cv::TM_CCOEFF_NORMED);
+    return result.at<float>(0, 0);
+}
@@ -0,0 +1,44 @@
+/**
+ * Step-and-repeat panels: a production panel holds a grid of identical boards at a fixed pitch.
+ *
+ * The pitch is found from the autocorrelation of a downscaled copy of the panel, then every board of the grid is
+ * registered against a reference board with a small texture patch at full resolution. Whatever is detected on the
+ * reference board can then be propagated to the other boards, with only a cheap comparison per detection.
+ */
+#ifndef COMMON_PANEL_HPP
+#define COMMON_PANEL_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct PanelLayout
+{
+    /// distance between neighbouring boards, the size of the image if the boards do not repeat in that direction
+    cv::Size pitch;
+    /// the registered boards, each of size pitch
+    std::vector<cv::Rect> boards;
+    /// registration score of every board against the reference (TM_CCOEFF_NORMED), 1 for the reference
+    std::vector<float> scores;
+    /// index of the reference board in boards
+    int reference = 0;
+    /// grid cells that did not match the reference well enough, e.g. a missing or different board
+    int rejected = 0;
+};
+
+/**
+ * Find the repeat pitch and the boards of a panel.
+ * The reference board is the board in the middle of the grid, the grid is centred on the image.
+ * @param img          Panel image
+ * @param maxPreview   The autocorrelation is computed on a preview of at most this many pixels wide and high
+ * @param minScore     Minimum registration score of a board
+ * @return             Layout of the panel, a single board covering the image if nothing repeats
+ */
+PanelLayout findPanelLayout(const cv::Mat &img, int maxPreview = 1024, float minScore = 0.6f);
+
+/**
+ * Similarity of two patches of the same size: the normalised correlation of their deviations from the mean.
+ * @return  Between -1 and 1
+ */
+float patchSimilarity(const cv::Mat &a, const cv::Mat &b);
+
+#endif //COMMON_PANEL_HPP
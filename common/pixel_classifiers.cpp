@@ -0,0 +1,137 @@
+#include "common/pixel_classifiers.hpp"
+
+cv::Mat hsvSamples(const cv::Mat &imgHsv, const std::vector<cv::Point> &points)
+{
+    cv::Mat samples((int)points.size(), 3, CV_32FC1);
+    for(int i = 0; i < (int)points.size(); i++)
+    {
+        cv::Vec3b hsv = imgHsv.at<cv::Vec3b>(points[i]);
+        float *row = samples.ptr<float>(i);
+        row[0] = hsv[0];
+        row[1] = hsv[1];
+        row[2] = hsv[2];
+    }
+    return samples;
+}
+
+PixelClassifiers trainPixelClassifiers(const cv::Mat &samplesFg, const cv::Mat &samplesBg, int k)
+{
+    cv::Mat samples, labels;
+    cv::vconcat(samplesFg, samplesBg, samples);
+    cv::vconcat(cv::Mat::ones(samplesFg.rows, 1, CV_32SC1), cv::Mat::zeros(samplesBg.rows, 1, CV_32SC1), labels);
+    cv::Ptr<cv::ml::TrainData> trainData = cv::ml::TrainData::create(samples, cv::ml::ROW_SAMPLE, labels);
+
+    PixelClassifiers classifiers;
+    classifiers.knn = cv::ml::KNearest::create();
+    classifiers.knn->setIsClassifier(true);
+    classifiers.knn->setDefaultK(k);
+    classifiers.knn->setAlgorithmType(cv::ml::KNearest::BRUTE_FORCE);
+    classifiers.knn->train(trainData);
+
+    classifiers.bayes = cv::ml::NormalBayesClassifier::create();
+    classifiers.bayes->train(trainData);
+
+    classifiers.svm = cv::ml::SVM::create();
+    classifiers.svm->setType(cv::ml::SVM::C_SVC);
+    classifiers.svm->setKernel(cv::ml::SVM::LINEAR);
+    classifiers.svm->setTermCriteria(cv::TermCriteria(cv::TermCriteria::MAX_ITER, 100, 1e-6));
+    classifiers.svm->train(trainData);
+    return classifiers;
+}
+
+void classifyPixels(const cv::Ptr<cv::ml::StatModel> &model, const cv::Mat &imgHsv, cv::Mat &mask, const cv::Mat &reject)
+{
+    cv::Mat samples, results;
+    if(reject.empty())
+    {
+        // 1 row of (H, S, V) per pixel; reshape needs a continuous matrix
+        cv::Mat hsv = imgHsv.isContinuous() ? imgHsv : imgHsv.clone();
+        hsv.reshape(1, (int)hsv.total()).convertTo(samples, CV_32F);
+        model->predict(samples, results);
+        // results holds the predicted label (0.0 or 1.0) per pixel
+        cv::compare(results.reshape(1, imgHsv.rows), 0.5, mask, cv::CMP_GT);
+        return;
+    }
+
+    CV_Assert(reject.type() == CV_8UC1 && reject.size() == imgHsv.size());
+    // only the pixels that pass the pre-filter become samples, in row-major order
+    samples.create((int)imgHsv.total() - cv::countNonZero(reject), 3, CV_32FC1);
+    int i = 0;
+    for(int y = 0; y < imgHsv.rows; y++)
+    {
+        const cv::Vec3b *hsv = imgHsv.ptr<cv::Vec3b>(y);
+        const uchar *r = reject.ptr<uchar>(y);
+        for(int x = 0; x < imgHsv.cols; x++)
+        {
+            if(r[x])
+                continue;
+            float *row = samples.ptr<float>(i++);
+            row[0] = hsv[x][0];
+            row[1] = hsv[x][1];
+            row[2] = hsv[x][2];
+        }
+    }
+    mask.create(imgHsv.size(), CV_8UC1);
+    mask.setTo(cv::Scalar(0));
+    if(samples.rows == 0)
+        return;
+    model->predict(samples, results);
+
+    // scatter the labels back in the same order
+    i = 0;
+    for(int y = 0; y < imgHsv.rows; y++)
+    {
+        const uchar *r = reject.ptr<uchar>(y);
+        uchar *m = mask.ptr<uchar>(y);
+        for(int x = 0; x < imgHsv.cols; x++)
+        {
+            if(!r[x])
+                m[x] = results.at<float>(i++) > 0.5f ? 255 : 0;
+        }
+    }
+}
+
+void classifyRegions(const cv::Ptr<cv::ml::StatModel> &model, const cv::Mat &samples, const cv::Mat &labels, cv::Mat &mask,
+                     const cv::Mat &reject)
+{
+    CV_Assert(labels.type() == CV_32SC1);
+    CV_Assert(reject.empty() || (reject.type() == CV_8UC1 && (int)reject.total() == samples.rows));
+    std::vector<uchar> foreground(samples.rows, 0);
+    // the regions that pass the pre-filter
+    std::vector<int> kept;
+    cv::Mat keptSamples;
+    for(int i = 0; i < samples.rows; i++)
+    {
+        if(!reject.empty() && reject.at<uchar>(i))
+            continue;
+        kept.push_back(i);
+        keptSamples.push_back(samples.row(i));
+    }
+    if(!kept.empty())
+    {
+        cv::Mat results;
+        model->predict(keptSamples, results);
+        for(size_t i = 0; i < kept.size(); i++)
+            foreground[kept[i]] = results.at<float>((int)i) > 0.5f ? 255 : 0;
+    }
+
+    mask.create(labels.size(), CV_8UC1);
+    for(int y = 0; y < labels.rows; y++)
+    {
+        const int *label = labels.ptr<int>(y);
+        uchar *m = mask.ptr<uchar>(y);
+        for(int x = 0; x < labels.cols; x++)
+            m[x] = foreground[label[x]];
+    }
+}
+
+cv::Mat hueRejectMask(const cv::Mat &hsv, int minHue, int maxHue)
+{
+    CV_Assert(hsv.type() == CV_8UC3 || (hsv.type() == CV_32FC1 && hsv.cols == 3));
+    cv::Mat reject;
+    if(hsv.type() == CV_8UC3)
+        cv::inRange(hsv, cv::Scalar(minHue, 0, 0), cv::Scalar(maxHue, 255, 255), reject);
+    else
+        cv::inRange(hsv.col(0), cv::Scalar(minHue), cv::Scalar(maxHue), reject);
+    return reject;
+}
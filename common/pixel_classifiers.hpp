@@ -0,0 +1,69 @@
+/**
+ * Per-pixel colour classification with OpenCV's machine learning module (sessie_5).
+ * Every pixel is described by its HSV value, and classified as foreground (1) or background (0).
+ */
+#ifndef COMMON_PIXEL_CLASSIFIERS_HPP
+#define COMMON_PIXEL_CLASSIFIERS_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/** The classifiers compared in sessie_5, trained on the same samples */
+struct PixelClassifiers
+{
+    cv::Ptr<cv::ml::KNearest> knn;
+    cv::Ptr<cv::ml::NormalBayesClassifier> bayes;
+    cv::Ptr<cv::ml::SVM> svm;
+};
+
+/**
+ * Build the descriptors of a set of pixels.
+ * @param imgHsv  HSV image (CV_8UC3)
+ * @param points  Pixels to describe
+ * @return        One row of 3 floats (H, S, V) per point
+ */
+cv::Mat hsvSamples(const cv::Mat &imgHsv, const std::vector<cv::Point> &points);
+
+/**
+ * Create and train KNN (brute force, k neighbours), Normal Bayes and a linear SVM.
+ * @param samplesFg  Descriptors of foreground pixels, labelled 1
+ * @param samplesBg  Descriptors of background pixels, labelled 0
+ * @param k          Number of neighbours for KNN
+ */
+PixelClassifiers trainPixelClassifiers(const cv::Mat &samplesFg, const cv::Mat &samplesBg, int k = 3);
+
+/**
+ * Classify all pixels of an image with 1 predict() call, instead of 1 call per pixel.
+ * @param model   Trained classifier
+ * @param imgHsv  HSV image (CV_8UC3)
+ * @param mask    Receives 255 for the foreground pixels, 0 elsewhere (CV_8UC1, size of imgHsv)
+ * @param reject  Optional pre-filter (CV_8UC1, size of imgHsv): non-zero pixels are background without being
+ *                passed to the classifier, see hueRejectMask()
+ */
+void classifyPixels(const cv::Ptr<cv::ml::StatModel> &model, const cv::Mat &imgHsv, cv::Mat &mask,
+                    const cv::Mat &reject = cv::Mat());
+
+/**
+ * Classify regions (e.g. superpixels) with 1 predict() call: one descriptor per region, the predicted label is
+ * painted back on all pixels of the region.
+ * @param model    Trained classifier
+ * @param samples  One row of descriptors per region, see superpixelHsvMeans()
+ * @param labels   Region of every pixel (CV_32SC1), from 0 to samples.rows - 1
+ * @param mask     Receives 255 for the pixels of foreground regions, 0 elsewhere (CV_8UC1, size of labels)
+ * @param reject   Optional pre-filter, one value per region (CV_8UC1, samples.rows x 1): non-zero regions are
+ *                 background without being passed to the classifier
+ */
+void classifyRegions(const cv::Ptr<cv::ml::StatModel> &model, const cv::Mat &samples, const cv::Mat &labels, cv::Mat &mask,
+                     const cv::Mat &reject = cv::Mat());
+
+/**
+ * Mask of the descriptors with a hue in [minHue, maxHue], e.g. the green leaves around the fruit in sessie_5.
+ * Pass it as the reject mask of classifyPixels() or classifyRegions(), so those pixels skip the classifier.
+ * @param hsv     HSV image (CV_8UC3), or one row of (H, S, V) floats per region (CV_32FC1)
+ * @param minHue  Lowest rejected hue (0..180)
+ * @param maxHue  Highest rejected hue (0..180)
+ * @return        255 for the rejected pixels or rows, 0 elsewhere (CV_8UC1)
+ */
+cv::Mat hueRejectMask(const cv::Mat &hsv, int minHue, int maxHue);
+
+#endif //COMMON_PIXEL_CLASSIFIERS_HPP
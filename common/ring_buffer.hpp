@@ -0,0 +1,51 @@
+/**
+ * Fixed-capacity ring buffer. When full, push() overwrites the oldest element.
+ * The storage is allocated once at construction, so pushing never allocates.
+ */
+#ifndef COMMON_RING_BUFFER_HPP
+#define COMMON_RING_BUFFER_HPP
+
+#include <cstddef>
+#include <vector>
+
+template<typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(size_t capacity = 0) : items(capacity), head(0), count(0) {}
+
+    /**
+     * Append an element, dropping the oldest one if the buffer is full.
+     * @param item  Element to append
+     */
+    void push(const T &item)
+    {
+        if(items.empty())
+            return;
+        items[(head + count) % items.size()] = item;
+        if(count < items.size())
+            count++;
+        else
+            head = (head + 1) % items.size();
+    }
+
+    /**
+     * @param i  Index, 0 is the oldest element
+     * @return   The i-th element
+     */
+    const T &operator[](size_t i) const { return items[(head + i) % items.size()]; }
+
+    /** @return The most recently pushed element. The buffer must not be empty. */
+    const T &back() const { return (*this)[count - 1]; }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return items.size(); }
+    bool empty() const { return count == 0; }
+    void clear() { head = count = 0; }
+
+private:
+    std::vector<T> items;
+    size_t head, count;
+};
+
+#endif //COMMON_RING_BUFFER_HPP
@@ -0,0 +1,233 @@
+#include "common/robust_homography.hpp"
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+
+const int SAMPLE_SIZE = 4;
+
+/** @return z component of (b - a) x (c - a), positive if a, b, c turn counter-clockwise */
+double cross(const cv::Point2f &a, const cv::Point2f &b, const cv::Point2f &c)
+{
+    return (double)(b.x - a.x) * (c.y - a.y) - (double)(b.y - a.y) * (c.x - a.x);
+}
+
+/** @return true if the triangle a, b, c is too thin to constrain a homography (angle at a below ~0.5 degrees) */
+bool collinear(const cv::Point2f &a, const cv::Point2f &b, const cv::Point2f &c)
+{
+    double cr = cross(a, b, c);
+    double ab = std::hypot(b.x - a.x, b.y - a.y), ac = std::hypot(c.x - a.x, c.y - a.y);
+    return std::abs(cr) <= 0.01 * ab * ac;
+}
+
+/**
+ * Cheap check of a minimal sample before fitting a model: no 3 points on a line in either image, and every triangle
+ * of the sample has the same orientation in both images.
+ */
+bool degenerateSample(const cv::Point2f *src, const cv::Point2f *dst)
+{
+    static const int triangles[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+    for(const int *t : triangles)
+    {
+        if(collinear(src[t[0]], src[t[1]], src[t[2]]) || collinear(dst[t[0]], dst[t[1]], dst[t[2]]))
+            return true;
+        if((cross(src[t[0]], src[t[1]], src[t[2]]) > 0) != (cross(dst[t[0]], dst[t[1]], dst[t[2]]) > 0))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Count the matches with a reprojection error below the threshold.
+ * @param stopBelow  Give up as soon as the count cannot reach this value any more
+ * @return           Number of inliers, or less than stopBelow if it gave up
+ */
+int countInliers(const cv::Mat &H, const std::vector<cv::Point2f> &src, const std::vector<cv::Point2f> &dst,
+                 double threshold, int stopBelow, uchar *mask = nullptr)
+{
+    const double *h = H.ptr<double>();
+    const double thr2 = threshold * threshold;
+    const int n = (int)src.size();
+    int inliers = 0;
+    for(int i = 0; i < n; i++)
+    {
+        double w = h[6] * src[i].x + h[7] * src[i].y + h[8];
+        bool inlier = false;
+        if(std::abs(w) > DBL_EPSILON)
+        {
+            double dx = (h[0] * src[i].x + h[1] * src[i].y + h[2]) / w - dst[i].x;
+            double dy = (h[3] * src[i].x + h[4] * src[i].y + h[5]) / w - dst[i].y;
+            inlier = dx * dx + dy * dy <= thr2;
+        }
+        inliers += inlier;
+        if(mask)
+            mask[i] = inlier;
+        else if(inliers + (n - 1 - i) < stopBelow)
+            break;
+    }
+    return inliers;
+}
+
+/**
+ * Refit a homography on its inliers with findHomography(method = 0), i.e. least squares refined with
+ * Levenberg-Marquardt, as long as that gains inliers. A model fitted on 4 noisy matches is only accurate near those
+ * matches, the refit extends it to the whole object.
+ * @param H        Homography, replaced by the refit if that has more inliers
+ * @param mask     Inliers of H (one byte per match), updated with H
+ * @param inliers  Number of inliers of H
+ * @return         Number of inliers of the returned H
+ */
+int refineOnInliers(cv::Mat &H, const std::vector<cv::Point2f> &src, const std::vector<cv::Point2f> &dst,
+                    double threshold, cv::Mat &mask, int inliers)
+{
+    const int MAX_REFITS = 4;
+    std::vector<cv::Point2f> inlierSrc, inlierDst;
+    cv::Mat refitMask(mask.rows, 1, CV_8UC1);
+    for(int r = 0; r < MAX_REFITS; r++)
+    {
+        inlierSrc.clear();
+        inlierDst.clear();
+        for(int i = 0; i < mask.rows; i++)
+        {
+            if(mask.at<uchar>(i))
+            {
+                inlierSrc.push_back(src[i]);
+                inlierDst.push_back(dst[i]);
+            }
+        }
+        cv::Mat refit = cv::findHomography(inlierSrc, inlierDst, 0);
+        if(refit.empty())
+            break;
+        int refitInliers = countInliers(refit, src, dst, threshold, 0, refitMask.ptr<uchar>());
+        if(refitInliers < inliers)
+            break;
+        H = refit;
+        refitMask.copyTo(mask);
+        if(refitInliers == inliers)
+            break;
+        inliers = refitInliers;
+    }
+    return inliers;
+}
+
+/**
+ * Non-randomness criterion of PROSAC: the number of inliers among n matches that a wrong model reaches with a
+ * probability below 5%, if every match that is not in its sample is an inlier of it with probability RANDOM_INLIER.
+ * The binomial distribution is approximated by a normal distribution.
+ */
+int minimumInliers(int n)
+{
+    const double RANDOM_INLIER = 0.05, Z_95 = 1.645;
+    double others = n - SAMPLE_SIZE;
+    return SAMPLE_SIZE + (int)std::ceil(others * RANDOM_INLIER + Z_95 * std::sqrt(others * RANDOM_INLIER * (1 - RANDOM_INLIER))) + 1;
+}
+
+}
+
+cv::Mat findHomographyProsac(const std::vector<cv::Point2f> &src, const std::vector<cv::Point2f> &dst,
+                             double threshold, cv::Mat &inlierMask, HomographyStats *stats,
+                             double confidence, int maxIterations)
+{
+    CV_Assert(src.size() == dst.size());
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    const int N = (int)src.size();
+    inlierMask = cv::Mat::zeros(N, 1, CV_8UC1);
+    HomographyStats result;
+
+    cv::Mat best;
+    int bestInliers = SAMPLE_SIZE - 1;
+    if(N >= SAMPLE_SIZE)
+    {
+        // PROSAC growth function: T_n is the expected number of samples (out of maxIterations uniform samples from
+        // all N matches) that only contain matches from the top n. The sampling set grows from the top 4 to all
+        // matches so that after t samples it holds the top n matches with T'_n >= t.
+        int n = SAMPLE_SIZE;
+        double Tn = maxIterations;
+        for(int i = 0; i < SAMPLE_SIZE; i++)
+            Tn *= (double)(n - i) / (N - i);
+        double TnPrime = 1;
+        int limit = maxIterations;
+
+        cv::RNG rng(0x5eed);
+        cv::Point2f sampleSrc[SAMPLE_SIZE], sampleDst[SAMPLE_SIZE];
+        int sample[SAMPLE_SIZE];
+        int t = 0;
+        while(t < limit)
+        {
+            t++;
+            while(t > TnPrime && n < N)
+            {
+                double Tnext = Tn * (n + 1) / (n + 1 - SAMPLE_SIZE);
+                TnPrime += std::ceil(Tnext - Tn);
+                Tn = Tnext;
+                n++;
+            }
+
+            // the newest match of the set is always in the sample, the others come from the matches before it;
+            // once the set holds all matches, sample uniformly
+            int drawn = 0, range = n;
+            if(t <= TnPrime)
+            {
+                sample[drawn++] = n - 1;
+                range = n - 1;
+            }
+            while(drawn < SAMPLE_SIZE)
+            {
+                int index = rng.uniform(0, range);
+                bool duplicate = false;
+                for(int j = 0; j < drawn; j++)
+                    duplicate = duplicate || sample[j] == index;
+                if(!duplicate)
+                    sample[drawn++] = index;
+            }
+            for(int j = 0; j < SAMPLE_SIZE; j++)
+            {
+                sampleSrc[j] = src[sample[j]];
+                sampleDst[j] = dst[sample[j]];
+            }
+            if(degenerateSample(sampleSrc, sampleDst))
+            {
+                result.degenerate++;
+                continue;
+            }
+
+            cv::Mat H = cv::getPerspectiveTransform(sampleSrc, sampleDst);
+            if(H.empty())
+                continue;
+            int inliers = countInliers(H, src, dst, threshold, bestInliers + 1);
+            if(inliers <= bestInliers)
+                continue;
+            best = H;
+            countInliers(best, src, dst, threshold, 0, inlierMask.ptr<uchar>());
+            bestInliers = refineOnInliers(best, src, dst, threshold, inlierMask, inliers);
+
+            // adaptive termination: enough samples to draw an all-inlier sample with the given confidence. The
+            // samples come from the top matches, so the inlier ratio of every top n' (n' >= n) counts, not only the
+            // ratio of all matches: with well-sorted matches the top is mostly inliers even if all matches are not.
+            // A top n' only counts if it has more inliers than a wrong model would get by chance (non-randomness).
+            int prefixInliers = 0;
+            for(int i = 0; i < N; i++)
+            {
+                prefixInliers += inlierMask.at<uchar>(i);
+                if(i + 1 < n || prefixInliers < minimumInliers(i + 1))
+                    continue;
+                double allInliers = std::pow((double)prefixInliers / (i + 1), SAMPLE_SIZE);
+                if(allInliers >= 1.0)
+                    limit = t;
+                else if(allInliers > 0)
+                    limit = (int)std::min((double)limit, t + std::ceil(std::log(1.0 - confidence) / std::log(1.0 - allInliers)));
+            }
+        }
+        result.iterations = t;
+    }
+
+    // the mask stays all zeros if no model was found
+    result.inliers = cv::countNonZero(inlierMask);
+
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if(stats)
+        *stats = result;
+    return best;
+}
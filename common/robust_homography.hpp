@@ -0,0 +1,50 @@
+/**
+ * Robust homography estimation for keypoint matches (sessie_4).
+ *
+ * Plain RANSAC draws its samples uniformly from all matches and, with OpenCV's defaults, keeps going until its
+ * worst-case iteration count is reached when most matches are noise. PROSAC (progressive sample consensus) uses the
+ * descriptor distance instead: the matches are sorted best first, and the samples are drawn from a set of top
+ * matches that grows with the number of iterations. Good matches are far more likely to be inliers, so an all-inlier
+ * sample is usually found within the first iterations, and the adaptive stopping criterion then ends the search.
+ */
+#ifndef COMMON_ROBUST_HOMOGRAPHY_HPP
+#define COMMON_ROBUST_HOMOGRAPHY_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/** What the estimation cost, for reporting the latency per frame */
+struct HomographyStats
+{
+    /// samples drawn, including the rejected ones
+    int iterations = 0;
+    /// samples rejected by the degeneracy check, without fitting a model
+    int degenerate = 0;
+    /// inliers of the returned homography
+    int inliers = 0;
+    /// wall time of the whole estimation, refinement included
+    double milliseconds = 0;
+};
+
+/**
+ * PROSAC homography estimation followed by a least-squares refinement on the inliers.
+ *
+ * Every sample of 4 matches is checked before a model is fitted: samples with 3 (nearly) collinear points, or whose
+ * points change orientation between src and dst (a homography of a plane seen from the front cannot mirror it), are
+ * rejected. Every new best model is refitted on all its inliers with findHomography(method = 0), i.e. least squares
+ * refined with Levenberg-Marquardt. The search stops as soon as the probability of having missed a better model, given
+ * the inlier ratio of the top matches so far, is below 1 - confidence.
+ * @param src           Points in the first image, sorted on match quality (best first, e.g. by descriptor distance)
+ * @param dst           Corresponding points in the second image
+ * @param threshold     Maximum reprojection error (pixels) of an inlier
+ * @param inlierMask    Receives 1 for the inliers, 0 for the outliers (CV_8UC1, one row per match)
+ * @param stats         If not null, receives the number of iterations and the time taken
+ * @param confidence    Required probability that the best model was found
+ * @param maxIterations Upper bound on the number of samples
+ * @return              3x3 homography (CV_64FC1) from src to dst, empty if no model with 4 inliers was found
+ */
+cv::Mat findHomographyProsac(const std::vector<cv::Point2f> &src, const std::vector<cv::Point2f> &dst,
+                             double threshold, cv::Mat &inlierMask, HomographyStats *stats = nullptr,
+                             double confidence = 0.995, int maxIterations = 2000);
+
+#endif //COMMON_ROBUST_HOMOGRAPHY_HPP
@@ -0,0 +1,212 @@
+/**
+ * Per-stage latency statistics for the video pipelines.
+ *
+ * Each stage (decode, detect, render, ...) records its latency per frame in a histogram with logarithmic bins,
+ * 10 bins per decade from 1 us to 100 s. Recording only increments atomic counters, so detector threads can
+ * record concurrently without locks and without allocating. Percentiles are read from the histogram and are
+ * accurate to the bin width (about 26%), which is enough to size hardware and to spot regressions.
+ * Next to the histograms, the frame, dropped frame and empty frame counters give the throughput of the pipeline.
+ */
+#ifndef COMMON_STAGE_STATS_HPP
+#define COMMON_STAGE_STATS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class LatencyHistogram
+{
+public:
+    static const int BINS_PER_DECADE = 10;
+    static const int NUM_BINS = 8 * BINS_PER_DECADE;
+
+    LatencyHistogram() : count(0), total_us(0), max_us(0)
+    {
+        for(std::atomic<long> &bin : bins)
+            bin = 0;
+    }
+
+    /**
+     * Add one measurement.
+     * @param seconds  Latency in seconds
+     */
+    void record(double seconds)
+    {
+        double us = std::max(seconds * 1e6, 1.0);
+        int bin = std::min((int)(std::log10(us) * BINS_PER_DECADE), NUM_BINS - 1);
+        bins[bin]++;
+        count++;
+        long us_rounded = (long)us;
+        total_us += us_rounded;
+        long prev = max_us;
+        while(us_rounded > prev && !max_us.compare_exchange_weak(prev, us_rounded)) {}
+    }
+
+    /**
+     * @param p  Percentile, between 0 and 100
+     * @return   Upper bound of the bin that holds the p-th percentile, in seconds
+     */
+    double percentile(double p) const
+    {
+        long n = count;
+        if(n == 0)
+            return 0.0;
+        long rank = std::max(1L, (long)std::ceil(p / 100.0 * n)), seen = 0;
+        for(int b = 0; b < NUM_BINS; b++)
+        {
+            seen += bins[b];
+            if(seen >= rank)
+                return std::min(std::pow(10.0, (double)(b + 1) / BINS_PER_DECADE), (double)max_us) * 1e-6;
+        }
+        return max_us * 1e-6;
+    }
+
+    long samples() const { return count; }
+    double mean() const { long n = count; return n ? total_us * 1e-6 / n : 0.0; }
+    double max() const { return max_us * 1e-6; }
+
+private:
+    std::atomic<long> bins[NUM_BINS];
+    std::atomic<long> count, total_us, max_us;
+};
+
+class StageStats
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @param stage_names  Names of the stages, in the order they are reported
+     */
+    explicit StageStats(const std::vector<std::string> &stage_names)
+        : names(stage_names), histograms(new LatencyHistogram[stage_names.size()]), num_frames(0), num_dropped(0),
+          num_empty(0), start(Clock::now()), last_report(start), frames_last_report(0) {}
+
+    /**
+     * Record the latency of one stage, thread-safe.
+     * @param stage  Index of the stage in stage_names
+     * @param since  Time the stage started
+     */
+    void record(int stage, Clock::time_point since) { histograms[stage].record(std::chrono::duration<double>(Clock::now() - since).count()); }
+    void record(int stage, double seconds) { histograms[stage].record(seconds); }
+
+    /** A frame went through the whole pipeline */
+    void frameDone() { num_frames++; }
+    /** A decoded frame was thrown away before it was rendered */
+    void frameDropped() { num_dropped++; }
+    /** The decoder returned a bad or empty frame */
+    void frameEmpty() { num_empty++; }
+
+    long frames() const { return num_frames; }
+    double elapsed() const { return std::chrono::duration<double>(Clock::now() - start).count(); }
+
+    /**
+     * Print a report when at least interval seconds passed since the previous one.
+     * @param out       Output stream, e.g. stderr
+     * @param interval  Seconds between reports, 0 disables periodic reports
+     * @param csv       Optional CSV file the report is appended to
+     */
+    void maybeReport(FILE *out, double interval, FILE *csv = nullptr)
+    {
+        if(interval > 0 && std::chrono::duration<double>(Clock::now() - last_report).count() >= interval)
+            report(out, csv);
+    }
+
+    /**
+     * Print the frame counters, the frames per second since the previous report and over the whole run,
+     * and the latency percentiles of every stage.
+     */
+    void report(FILE *out, FILE *csv = nullptr)
+    {
+        Clock::time_point now = Clock::now();
+        double total = std::chrono::duration<double>(now - start).count();
+        double interval = std::chrono::duration<double>(now - last_report).count();
+        long frames = num_frames;
+        double fps = total > 0 ? frames / total : 0.0;
+        double fps_interval = interval > 0 ? (frames - frames_last_report) / interval : 0.0;
+        last_report = now;
+        frames_last_report = frames;
+
+        fprintf(out, "[%7.1f s] frames %ld, %.1f fps (%.1f fps overall), dropped %ld, empty %ld\n",
+                total, frames, fps_interval, fps, (long)num_dropped, (long)num_empty);
+        fprintf(out, "    %-10s %8s %9s %9s %9s %9s %9s\n", "stage", "count", "mean ms", "p50 ms", "p95 ms", "p99 ms", "max ms");
+        for(size_t s = 0; s < names.size(); s++)
+        {
+            const LatencyHistogram &h = histograms[s];
+            fprintf(out, "    %-10s %8ld %9.2f %9.2f %9.2f %9.2f %9.2f\n", names[s].c_str(), h.samples(), h.mean() * 1e3,
+                    h.percentile(50) * 1e3, h.percentile(95) * 1e3, h.percentile(99) * 1e3, h.max() * 1e3);
+            if(csv)
+                fprintf(csv, "%.3f,%s,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%ld,%.2f,%ld,%ld\n", total, names[s].c_str(), h.samples(),
+                        h.mean() * 1e3, h.percentile(50) * 1e3, h.percentile(95) * 1e3, h.percentile(99) * 1e3, h.max() * 1e3,
+                        frames, fps, (long)num_dropped, (long)num_empty);
+        }
+        if(csv)
+            fflush(csv);
+    }
+
+    /** Write the CSV header matching the rows written by report() */
+    static void writeCsvHeader(FILE *csv)
+    {
+        fprintf(csv, "time_s,stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,frames,fps,dropped,empty\n");
+    }
+
+    /**
+     * Open a CSV file for report() in append mode, so the statistics of earlier runs are kept.
+     * The header is only written when the file is new or empty.
+     * @return  The file, or nullptr if it could not be opened
+     */
+    static FILE *openCsv(const std::string &path)
+    {
+        FILE *csv = fopen(path.c_str(), "a");
+        if(!csv)
+            return nullptr;
+        fseek(csv, 0, SEEK_END);
+        if(ftell(csv) == 0)
+            writeCsvHeader(csv);
+        return csv;
+    }
+
+private:
+    std::vector<std::string> names;
+    std::unique_ptr<LatencyHistogram[]> histograms;
+    std::atomic<long> num_frames, num_dropped, num_empty;
+    Clock::time_point start, last_report;
+    long frames_last_report;
+};
+
+/**
+ * Read the next frame of a video, skipping bad or empty frames in the middle of the stream.
+ * Past the last frame (or when a video file has no frame count) the end of the stream is reached, and after max_bad
+ * bad frames in a row the stream is considered broken, so this never loops forever.
+ * @param cap      Opened video
+ * @param frame    Receives the frame
+ * @param stats    Counts the skipped frames
+ * @param max_bad  Maximum number of bad frames in a row that are skipped
+ * @param live     Camera or network stream: it has no frame count and no end, every failed read is a bad frame
+ * @return         false at the end of the stream
+ */
+inline bool readVideoFrame(cv::VideoCapture &cap, cv::Mat &frame, StageStats &stats, int max_bad = 25,
+                           bool live = false)
+{
+    for(int bad = 0; bad <= max_bad; bad++)
+    {
+        if(cap.read(frame) && !frame.empty())
+            return true;
+        if(!live)
+        {
+            double count = cap.get(cv::CAP_PROP_FRAME_COUNT);
+            if(count <= 0 || cap.get(cv::CAP_PROP_POS_FRAMES) >= count)
+                return false;
+        }
+        stats.frameEmpty();
+    }
+    return false;
+}
+
+#endif //COMMON_STAGE_STATS_HPP
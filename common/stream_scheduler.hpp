@@ -0,0 +1,90 @@
+/**
+ * Fair scheduling of many video streams on a fixed pool of worker threads.
+ *
+ * A worker asks for a stream, processes one frame of it and hands the stream back. A stream is handed to at most one
+ * worker at a time, so its frames are processed in order and its state (capture, tracker, ...) needs no locking, and
+ * a stream never has more than one frame in flight: a stream that produces frames faster than they are processed
+ * waits in its source instead of filling memory. The streams are handed out round robin, so every stream gets one
+ * frame processed per round, however fast or slow the others are.
+ */
+#ifndef COMMON_STREAM_SCHEDULER_HPP
+#define COMMON_STREAM_SCHEDULER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+class StreamScheduler
+{
+public:
+    explicit StreamScheduler(size_t num_streams)
+        : busy(num_streams, false), finished(num_streams, false), next(0), num_active(num_streams), stopped(false) {}
+
+    StreamScheduler(const StreamScheduler &) = delete;
+    StreamScheduler &operator=(const StreamScheduler &) = delete;
+
+    /**
+     * Wait for the next stream in round robin order that is neither busy nor finished.
+     * @param stream  Receives the index of the stream, which is busy until release()
+     * @return        false when all streams are finished or stop() was called
+     */
+    bool acquire(size_t &stream)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true)
+        {
+            if(stopped || num_active == 0)
+                return false;
+            for(size_t i = 0; i < busy.size(); i++)
+            {
+                size_t s = (next + i) % busy.size();
+                if(busy[s] || finished[s])
+                    continue;
+                busy[s] = true;
+                next = (s + 1) % busy.size();
+                stream = s;
+                return true;
+            }
+            idle.wait(lock);
+        }
+    }
+
+    /**
+     * Hand a stream back after processing a frame of it.
+     * @param stream  Index of the stream returned by acquire()
+     * @param done    true if the stream has no more frames
+     */
+    void release(size_t stream, bool done)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy[stream] = false;
+            if(done && !finished[stream])
+            {
+                finished[stream] = true;
+                num_active--;
+            }
+        }
+        idle.notify_all();
+    }
+
+    /** Let all waiting and future acquire() calls fail */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        idle.notify_all();
+    }
+
+private:
+    std::vector<bool> busy, finished;
+    size_t next, num_active;
+    bool stopped;
+    std::mutex mutex;
+    std::condition_variable idle;
+};
+
+#endif //COMMON_STREAM_SCHEDULER_HPP
@@ -0,0 +1,214 @@
+#include "common/superpixels.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+struct Center
+{
+    float c[3], x, y;
+};
+
+/** Move a seed to the lowest colour gradient in its 3x3 neighbourhood, so it does not start on an edge */
+void moveToLowGradient(const cv::Mat &img, Center &center)
+{
+    int cx = (int)center.x, cy = (int)center.y;
+    float best = FLT_MAX;
+    for(int y = std::max(cy - 1, 1); y <= std::min(cy + 1, img.rows - 2); y++)
+        for(int x = std::max(cx - 1, 1); x <= std::min(cx + 1, img.cols - 2); x++)
+        {
+            const cv::Vec3b &l = img.at<cv::Vec3b>(y, x - 1), &r = img.at<cv::Vec3b>(y, x + 1);
+            const cv::Vec3b &t = img.at<cv::Vec3b>(y - 1, x), &b = img.at<cv::Vec3b>(y + 1, x);
+            float g = 0;
+            for(int k = 0; k < 3; k++)
+                g += (float)(r[k] - l[k]) * (r[k] - l[k]) + (float)(b[k] - t[k]) * (b[k] - t[k]);
+            if(g < best)
+            {
+                best = g;
+                center.x = (float)x;
+                center.y = (float)y;
+            }
+        }
+    const cv::Vec3b &p = img.at<cv::Vec3b>((int)center.y, (int)center.x);
+    for(int k = 0; k < 3; k++)
+        center.c[k] = p[k];
+}
+
+/**
+ * Give every 4-connected fragment its own label, and merge the fragments smaller than minSize into the fragment
+ * visited before them. The labels are renumbered from 0.
+ * @return  Number of labels
+ */
+int enforceConnectivity(cv::Mat &labels, int minSize)
+{
+    cv::Mat relabeled(labels.size(), CV_32SC1, cv::Scalar(-1));
+    std::vector<cv::Point> fragment;
+    const int dx[] = {-1, 1, 0, 0}, dy[] = {0, 0, -1, 1};
+    int next = 0;
+    for(int y = 0; y < labels.rows; y++)
+        for(int x = 0; x < labels.cols; x++)
+        {
+            if(relabeled.at<int>(y, x) >= 0)
+                continue;
+            // a neighbouring fragment that was already labelled, for merging a small fragment
+            int adjacent = next > 0 ? next - 1 : 0;
+            for(int d = 0; d < 4; d++)
+            {
+                int nx = x + dx[d], ny = y + dy[d];
+                if(nx >= 0 && ny >= 0 && nx < labels.cols && ny < labels.rows && relabeled.at<int>(ny, nx) >= 0)
+                    adjacent = relabeled.at<int>(ny, nx);
+            }
+
+            int original = labels.at<int>(y, x);
+            fragment.assign(1, cv::Point(x, y));
+            relabeled.at<int>(y, x) = next;
+            for(size_t i = 0; i < fragment.size(); i++)
+                for(int d = 0; d < 4; d++)
+                {
+                    int nx = fragment[i].x + dx[d], ny = fragment[i].y + dy[d];
+                    if(nx < 0 || ny < 0 || nx >= labels.cols || ny >= labels.rows)
+                        continue;
+                    if(relabeled.at<int>(ny, nx) >= 0 || labels.at<int>(ny, nx) != original)
+                        continue;
+                    relabeled.at<int>(ny, nx) = next;
+                    fragment.emplace_back(nx, ny);
+                }
+
+            if((int)fragment.size() < minSize && next > 0)
+            {
+                for(const cv::Point &p : fragment)
+                    relabeled.at<int>(p) = adjacent;
+            }
+            else
+                next++;
+        }
+    labels = relabeled;
+    return next;
+}
+
+}
+
+int slicSuperpixels(const cv::Mat &img, int regionSize, float compactness, cv::Mat &labels, int iterations)
+{
+    CV_Assert(img.type() == CV_8UC3 && regionSize > 0);
+    const int step = regionSize;
+    std::vector<Center> centers;
+    for(int y = step / 2; y < img.rows; y += step)
+        for(int x = step / 2; x < img.cols; x += step)
+        {
+            Center center = {{0, 0, 0}, (float)x, (float)y};
+            moveToLowGradient(img, center);
+            centers.push_back(center);
+        }
+
+    labels.create(img.size(), CV_32SC1);
+    labels.setTo(cv::Scalar(0));
+    cv::Mat distance(img.size(), CV_32FC1);
+    // distance = colour distance^2 + (position distance / step)^2 * compactness^2
+    const float spatialWeight = compactness * compactness / (float)(step * step);
+    std::vector<double> sums;
+    std::vector<int> counts;
+    for(int it = 0; it < iterations; it++)
+    {
+        distance.setTo(cv::Scalar(FLT_MAX));
+        for(int k = 0; k < (int)centers.size(); k++)
+        {
+            const Center &center = centers[k];
+            int x0 = std::max((int)center.x - step, 0), x1 = std::min((int)center.x + step, img.cols - 1);
+            int y0 = std::max((int)center.y - step, 0), y1 = std::min((int)center.y + step, img.rows - 1);
+            for(int y = y0; y <= y1; y++)
+            {
+                const cv::Vec3b *p = img.ptr<cv::Vec3b>(y);
+                float *dist = distance.ptr<float>(y);
+                int *label = labels.ptr<int>(y);
+                float ddy = (y - center.y) * (y - center.y);
+                for(int x = x0; x <= x1; x++)
+                {
+                    float d0 = p[x][0] - center.c[0], d1 = p[x][1] - center.c[1], d2 = p[x][2] - center.c[2];
+                    float d = d0 * d0 + d1 * d1 + d2 * d2 + ((x - center.x) * (x - center.x) + ddy) * spatialWeight;
+                    if(d < dist[x])
+                    {
+                        dist[x] = d;
+                        label[x] = k;
+                    }
+                }
+            }
+        }
+
+        // move every centre to the mean of its pixels
+        sums.assign(centers.size() * 5, 0.0);
+        counts.assign(centers.size(), 0);
+        for(int y = 0; y < img.rows; y++)
+        {
+            const cv::Vec3b *p = img.ptr<cv::Vec3b>(y);
+            const int *label = labels.ptr<int>(y);
+            for(int x = 0; x < img.cols; x++)
+            {
+                double *s = &sums[label[x] * 5];
+                s[0] += p[x][0];
+                s[1] += p[x][1];
+                s[2] += p[x][2];
+                s[3] += x;
+                s[4] += y;
+                counts[label[x]]++;
+            }
+        }
+        for(size_t k = 0; k < centers.size(); k++)
+        {
+            if(counts[k] == 0)
+                continue;
+            const double *s = &sums[k * 5];
+            for(int c = 0; c < 3; c++)
+                centers[k].c[c] = (float)(s[c] / counts[k]);
+            centers[k].x = (float)(s[3] / counts[k]);
+            centers[k].y = (float)(s[4] / counts[k]);
+        }
+    }
+    return enforceConnectivity(labels, std::max(step * step / 4, 1));
+}
+
+cv::Mat superpixelHsvMeans(const cv::Mat &imgHsv, const cv::Mat &labels, int numLabels)
+{
+    CV_Assert(imgHsv.type() == CV_8UC3 && labels.type() == CV_32SC1 && imgHsv.size() == labels.size());
+    // hue as a unit vector on the hue circle (0..180 in OpenCV = 0..360 degrees)
+    float cosHue[180], sinHue[180];
+    for(int h = 0; h < 180; h++)
+    {
+        cosHue[h] = (float)std::cos(h * CV_PI / 90.0);
+        sinHue[h] = (float)std::sin(h * CV_PI / 90.0);
+    }
+    std::vector<double> sums(numLabels * 4, 0.0);
+    std::vector<int> counts(numLabels, 0);
+    for(int y = 0; y < imgHsv.rows; y++)
+    {
+        const cv::Vec3b *p = imgHsv.ptr<cv::Vec3b>(y);
+        const int *label = labels.ptr<int>(y);
+        for(int x = 0; x < imgHsv.cols; x++)
+        {
+            double *s = &sums[label[x] * 4];
+            int h = std::min((int)p[x][0], 179);
+            s[0] += cosHue[h];
+            s[1] += sinHue[h];
+            s[2] += p[x][1];
+            s[3] += p[x][2];
+            counts[label[x]]++;
+        }
+    }
+
+    cv::Mat means(numLabels, 3, CV_32FC1, cv::Scalar(0));
+    for(int k = 0; k < numLabels; k++)
+    {
+        if(counts[k] == 0)
+            continue;
+        const double *s = &sums[k * 4];
+        double hue = std::atan2(s[1], s[0]) * 90.0 / CV_PI;
+        float *row = means.ptr<float>(k);
+        row[0] = (float)(hue < 0 ? hue + 180.0 : hue);
+        row[1] = (float)(s[2] / counts[k]);
+        row[2] = (float)(s[3] / counts[k]);
+    }
+    return means;
+}
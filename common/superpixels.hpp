@@ -0,0 +1,33 @@
+/**
+ * Superpixels: an over-segmentation of an image into compact regions of similar colour (sessie_5).
+ * Large smooth regions, like the fruit in sessie_5, are then classified once per superpixel instead of once per pixel.
+ */
+#ifndef COMMON_SUPERPIXELS_HPP
+#define COMMON_SUPERPIXELS_HPP
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * SLIC superpixels (simple linear iterative clustering): k-means on colour and position, seeded on a regular grid.
+ * Every cluster only competes for the pixels within one grid step of its centre, so an iteration is linear in the
+ * number of pixels. Afterwards, fragments that are not connected to their cluster are merged into a neighbour.
+ * @param img          CV_8UC3 image, clustered in its own colour space (Lab works best)
+ * @param regionSize   Grid step of the seeds, the superpixels are about this size
+ * @param compactness  Weight of the position against the colour, higher gives more regular superpixels
+ * @param labels       Receives the superpixel of every pixel (CV_32SC1), numbered from 0
+ * @param iterations   Number of k-means iterations
+ * @return             Number of superpixels
+ */
+int slicSuperpixels(const cv::Mat &img, int regionSize, float compactness, cv::Mat &labels, int iterations = 5);
+
+/**
+ * Mean HSV value of every superpixel. The hue is averaged on the hue circle, so red pixels on both sides of 0
+ * average to red instead of cyan.
+ * @param imgHsv     HSV image (CV_8UC3, hue from 0 to 180)
+ * @param labels     Superpixel labels, see slicSuperpixels()
+ * @param numLabels  Number of superpixels
+ * @return           One row of 3 floats (H, S, V) per superpixel, like hsvSamples()
+ */
+cv::Mat superpixelHsvMeans(const cv::Mat &imgHsv, const cv::Mat &labels, int numLabels);
+
+#endif //COMMON_SUPERPIXELS_HPP
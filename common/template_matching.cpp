@@ -0,0 +1,87 @@
+#include "common/template_matching.hpp"
+#include "common/ncc_matching.hpp"
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+
+template<typename T>
+void collectPeaks(const cv::Mat &response, const cv::Mat &labels, int numLabels, std::vector<cv::Point> &peaks,
+                  std::vector<float> &best)
+{
+    peaks.assign(numLabels, cv::Point(-1, -1));
+    best.assign(numLabels, -std::numeric_limits<float>::max());
+    for(int r = 0; r < response.rows; r++)
+    {
+        const T *value = response.ptr<T>(r);
+        const int *label = labels.ptr<int>(r);
+        for(int c = 0; c < response.cols; c++)
+        {
+            int l = label[c];
+            if(l > 0 && value[c] > best[l])
+            {
+                best[l] = (float)value[c];
+                peaks[l] = cv::Point(c, r);
+            }
+        }
+    }
+    // label 0 is the background
+    peaks.erase(peaks.begin());
+    best.erase(best.begin());
+}
+
+}
+
+void findPeaks(const cv::Mat &response, double thr, std::vector<cv::Point> &peaks, std::vector<float> *scores,
+               MatPool *pool)
+{
+    CV_Assert(response.type() == CV_8UC1 || response.type() == CV_32FC1);
+    cv::Mat mask, labels;
+    if(pool)
+    {
+        mask = pool->acquire(response.size(), CV_8UC1);
+        labels = pool->acquire(response.size(), CV_32SC1);
+    }
+    std::vector<float> best;
+
+    cv::compare(response, thr, mask, cv::CMP_GT);
+    int numLabels = cv::connectedComponents(mask, labels, 8, CV_32S);
+    if(response.type() == CV_8UC1)
+        collectPeaks<uchar>(response, labels, numLabels, peaks, best);
+    else
+        collectPeaks<float>(response, labels, numLabels, peaks, best);
+    if(scores)
+        scores->swap(best);
+}
+
+void computeTplScoreMap(const cv::Mat &imgSearch, const cv::Mat &imgTpl, cv::Mat &scoreMap)
+{
+    matchTemplateNcc(imgSearch, imgTpl, scoreMap);
+    cv::normalize(scoreMap, scoreMap, 0, 1.0, cv::NORM_MINMAX, CV_32FC1);
+}
+
+std::vector<cv::Rect> findTplMatches(const cv::Mat &scoreMap, cv::Size tplSize, float thr, std::vector<float> *scores,
+                                     MatPool *pool)
+{
+    std::vector<cv::Point> peaks;
+    std::vector<cv::Rect> result;
+
+    if(thr > 1.0 || thr < 0.0)
+    {
+        throw std::domain_error("Threshold must be between 0.0 and 1.0 inclusive");
+    }
+
+    findPeaks(scoreMap, thr, peaks, scores, pool);
+    result.reserve(peaks.size());
+    for(const cv::Point &peak : peaks)
+        result.emplace_back(peak, tplSize);
+    return result;
+}
+
+std::vector<cv::Rect> findTplMatches(const cv::Mat &imgSearch, const cv::Mat &imgTpl, float thr, std::vector<float> *scores)
+{
+    cv::Mat scoreMap;
+    computeTplScoreMap(imgSearch, imgTpl, scoreMap);
+    return findTplMatches(scoreMap, imgTpl.size(), thr, scores);
+}
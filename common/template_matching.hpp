@@ -0,0 +1,55 @@
+/**
+ * Template matching and peak extraction, shared by sessie_3 and pcb_bestukker.
+ */
+#ifndef COMMON_TEMPLATE_MATCHING_HPP
+#define COMMON_TEMPLATE_MATCHING_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "common/mat_pool.hpp"
+
+/**
+ * Find the local maxima of a match map: the response is thresholded, and for every connected region above the
+ * threshold the location of the highest response is returned.
+ * All regions are handled in a single pass over the label image, instead of masking the response once per region.
+ * @param response  Single channel match map (CV_8U or CV_32F)
+ * @param thr       Only responses above thr are part of a region
+ * @param peaks     Receives the location of the maximum of each region
+ * @param scores    If not null, receives the response at each peak
+ * @param pool      If not null, the mask and label images are borrowed from this pool instead of allocated
+ */
+void findPeaks(const cv::Mat &response, double thr, std::vector<cv::Point> &peaks, std::vector<float> *scores = nullptr,
+               MatPool *pool = nullptr);
+
+/**
+ * Score map of a template: normalised cross correlation, rescaled so the best match scores 1.0.
+ * Small templates use the direct kernel of matchTemplateNcc(), larger ones matchTemplate().
+ * @param imgSearch  Image to search for template
+ * @param imgTpl     Template image
+ * @param scoreMap   Receives the score of each template position (CV_32FC1)
+ */
+void computeTplScoreMap(const cv::Mat &imgSearch, const cv::Mat &imgTpl, cv::Mat &scoreMap);
+
+/**
+ * Bounding boxes of the matches in a score map computed by computeTplScoreMap().
+ * @param scoreMap  Score map
+ * @param tplSize   Size of the template
+ * @param thr       Threshold value for matched templates (must be 0.0 and 1.0 inclusive)
+ * @param scores    If not null, receives the score of each match
+ * @param pool      If not null, scratch images are borrowed from this pool
+ * @return          Vector of bouding boxes of matched templates
+ */
+std::vector<cv::Rect> findTplMatches(const cv::Mat &scoreMap, cv::Size tplSize, float thr, std::vector<float> *scores = nullptr,
+                                     MatPool *pool = nullptr);
+
+/**
+ * Match a template with normalised cross correlation and return a bounding box per match.
+ * @param imgSearch  Image to search for template
+ * @param imgTpl     Template image
+ * @param thr        Threshold value for matched templates, relative to the best match (must be 0.0 and 1.0 inclusive)
+ * @param scores     If not null, receives the normalised score (0.0 - 1.0) of each match
+ * @return           Vector of bouding boxes of matched templates
+ */
+std::vector<cv::Rect> findTplMatches(const cv::Mat &imgSearch, const cv::Mat &imgTpl, float thr, std::vector<float> *scores = nullptr);
+
+#endif //COMMON_TEMPLATE_MATCHING_HPP
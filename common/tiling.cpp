@@ -0,0 +1,140 @@
+#include "common/tiling.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+
+int findRoot(std::vector<int> &parent, int i)
+{
+    while(parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+void unite(std::vector<int> &parent, int a, int b)
+{
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if(a != b)
+        parent[std::max(a, b)] = std::min(a, b);
+}
+
+}
+
+TileGrid::TileGrid(cv::Size imageSize, int tileSize) : image_size(imageSize)
+{
+    CV_Assert(tileSize > 0);
+    num_rows = (imageSize.height + tileSize - 1) / tileSize;
+    num_cols = (imageSize.width + tileSize - 1) / tileSize;
+    cv::Rect image(0, 0, imageSize.width, imageSize.height);
+    for(int r = 0; r < num_rows; r++)
+        for(int c = 0; c < num_cols; c++)
+            all.push_back({(int)all.size(), r, c, cv::Rect(c * tileSize, r * tileSize, tileSize, tileSize) & image});
+}
+
+cv::Rect TileGrid::withHalo(const Tile &tile, int halo) const
+{
+    cv::Rect grown(tile.core.x - halo, tile.core.y - halo, tile.core.width + 2 * halo, tile.core.height + 2 * halo);
+    return grown & cv::Rect(0, 0, image_size.width, image_size.height);
+}
+
+TiledComponents::TiledComponents(const TileGrid &grid) : grid(grid), tiles(grid.tiles().size()) {}
+
+void TiledComponents::add(const Tile &tile, const cv::Mat &binary)
+{
+    CV_Assert(binary.type() == CV_8UC1 && binary.size() == tile.core.size());
+    cv::Mat labels, stats, centroids;
+    int n = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8, CV_32S);
+
+    TileComponents &t = tiles[tile.index];
+    t.area.resize(n - 1);
+    t.box.resize(n - 1);
+    for(int i = 1; i < n; i++)
+    {
+        t.area[i - 1] = stats.at<int>(i, cv::CC_STAT_AREA);
+        t.box[i - 1] = cv::Rect(stats.at<int>(i, cv::CC_STAT_LEFT) + tile.core.x, stats.at<int>(i, cv::CC_STAT_TOP) + tile.core.y,
+                                stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT));
+    }
+    const int *first = labels.ptr<int>(0), *last = labels.ptr<int>(labels.rows - 1);
+    t.top.assign(first, first + labels.cols);
+    t.bottom.assign(last, last + labels.cols);
+    t.left.resize(labels.rows);
+    t.right.resize(labels.rows);
+    for(int r = 0; r < labels.rows; r++)
+    {
+        t.left[r] = labels.ptr<int>(r)[0];
+        t.right[r] = labels.ptr<int>(r)[labels.cols - 1];
+    }
+}
+
+void TiledComponents::merge(std::vector<int> &areas, std::vector<cv::Rect> &boxes) const
+{
+    // label l > 0 of tile t gets the global id offset[t] + l - 1
+    std::vector<int> offset(tiles.size() + 1, 0);
+    for(size_t t = 0; t < tiles.size(); t++)
+        offset[t + 1] = offset[t] + (int)tiles[t].area.size();
+    std::vector<int> parent(offset.back());
+    std::iota(parent.begin(), parent.end(), 0);
+
+    // join the labels that touch across a seam, a pixel touches the three pixels facing it in the neighbouring tile
+    auto joinEdges = [&](int ta, const std::vector<int> &a, int tb, const std::vector<int> &b)
+    {
+        for(int i = 0; i < (int)a.size(); i++)
+        {
+            if(a[i] == 0)
+                continue;
+            for(int j = std::max(i - 1, 0); j <= std::min(i + 1, (int)b.size() - 1); j++)
+                if(b[j] != 0)
+                    unite(parent, offset[ta] + a[i] - 1, offset[tb] + b[j] - 1);
+        }
+    };
+    auto joinCorner = [&](int ta, int la, int tb, int lb)
+    {
+        if(la != 0 && lb != 0)
+            unite(parent, offset[ta] + la - 1, offset[tb] + lb - 1);
+    };
+    for(const Tile &tile : grid.tiles())
+    {
+        int r = tile.row, c = tile.col, t = tile.index;
+        const TileComponents &a = tiles[t];
+        if(c + 1 < grid.cols())
+            joinEdges(t, a.right, grid.tile(r, c + 1).index, tiles[grid.tile(r, c + 1).index].left);
+        if(r + 1 < grid.rows())
+        {
+            int below = grid.tile(r + 1, c).index;
+            joinEdges(t, a.bottom, below, tiles[below].top);
+            if(c + 1 < grid.cols())
+            {
+                int diagonal = grid.tile(r + 1, c + 1).index;
+                joinCorner(t, a.bottom.back(), diagonal, tiles[diagonal].top.front());
+            }
+            if(c > 0)
+            {
+                int diagonal = grid.tile(r + 1, c - 1).index;
+                joinCorner(t, a.bottom.front(), diagonal, tiles[diagonal].top.back());
+            }
+        }
+    }
+
+    // sum the statistics per root, in the order of the roots
+    std::vector<int> component(parent.size(), -1);
+    areas.clear();
+    boxes.clear();
+    for(size_t t = 0; t < tiles.size(); t++)
+        for(size_t l = 0; l < tiles[t].area.size(); l++)
+        {
+            int root = findRoot(parent, offset[t] + (int)l);
+            if(component[root] < 0)
+            {
+                component[root] = (int)areas.size();
+                areas.push_back(0);
+                boxes.push_back(tiles[t].box[l]);
+            }
+            areas[component[root]] += tiles[t].area[l];
+            boxes[component[root]] |= tiles[t].box[l];
+        }
+}
@@ -0,0 +1,101 @@
+/**
+ * Tiled processing of images that are too large to process in one piece, like line-scan panel images.
+ *
+ * The image is split in a grid of tiles. Every tile owns its core rectangle: a result (a peak, a pixel of a mask)
+ * belongs to the tile whose core contains it, so nothing is reported twice. Filters read a halo around the core,
+ * at least as large as their template or kernel, so filter results inside the core are the same as on the whole image.
+ * Results of a connected region (like the maximum of a peak region) are only the same if the region fits in the
+ * halo; a larger region is cut at the edge of the halo, and its parts can be reported by two tiles.
+ * Only one tile per thread is in flight, so the memory used for processing is bounded by the tile size and the
+ * number of threads, not by the image size. The image itself is best memory-mapped (see MatCache), so only the
+ * tiles being processed are paged in.
+ */
+#ifndef COMMON_TILING_HPP
+#define COMMON_TILING_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct Tile
+{
+    int index, row, col;
+    /// part of the image owned by this tile
+    cv::Rect core;
+};
+
+class TileGrid
+{
+public:
+    /**
+     * @param imageSize  Size of the image
+     * @param tileSize   Width and height of a tile core, the tiles in the last row and column may be smaller
+     */
+    TileGrid(cv::Size imageSize, int tileSize);
+
+    int rows() const { return num_rows; }
+    int cols() const { return num_cols; }
+    const std::vector<Tile> &tiles() const { return all; }
+    const Tile &tile(int row, int col) const { return all[row * num_cols + col]; }
+
+    /** @return The core of tile grown by halo pixels on every side, clipped to the image */
+    cv::Rect withHalo(const Tile &tile, int halo) const;
+
+    /**
+     * Process all tiles in parallel on the OpenCV thread pool.
+     * @param f  Called as f(const Tile &) for every tile, concurrently for different tiles
+     */
+    template<typename F>
+    void forEach(F f) const
+    {
+        cv::parallel_for_(cv::Range(0, (int)all.size()), [&](const cv::Range &range)
+        {
+            for(int t = range.start; t < range.end; t++)
+                f(all[t]);
+        });
+    }
+
+private:
+    cv::Size image_size;
+    int num_rows, num_cols;
+    std::vector<Tile> all;
+};
+
+/**
+ * Connected components (8-connectivity) of a binary image that is processed in tiles, merged across the tile seams.
+ * Every tile labels its own core. Only the statistics of its components and the labels on the border of its core are
+ * kept, which is enough to join the components that continue in a neighbouring tile with union-find.
+ */
+class TiledComponents
+{
+public:
+    explicit TiledComponents(const TileGrid &grid);
+
+    /**
+     * Label the core of one tile. Thread-safe for different tiles.
+     * @param tile    Tile of the grid passed to the constructor
+     * @param binary  Binary image of the core of the tile (CV_8UC1, tile.core.size())
+     */
+    void add(const Tile &tile, const cv::Mat &binary);
+
+    /**
+     * Join the components across the seams, after all tiles were added.
+     * @param areas  Receives the area of every component
+     * @param boxes  Receives the bounding box of every component, in image coordinates
+     */
+    void merge(std::vector<int> &areas, std::vector<cv::Rect> &boxes) const;
+
+private:
+    struct TileComponents
+    {
+        /// statistics of labels 1..n, bounding boxes in image coordinates
+        std::vector<int> area;
+        std::vector<cv::Rect> box;
+        /// labels along the border of the core, 0 is background
+        std::vector<int> top, bottom, left, right;
+    };
+
+    const TileGrid &grid;
+    std::vector<TileComponents> tiles;
+};
+
+#endif //COMMON_TILING_HPP
@@ -19,6 +19,28 @@
  *   Only large connected components represent the outlines, so the trackbar is used to select a value for the minimum pixel area of the connected components to keep.
  * - Finally, the resulted "assembled" PCB appears.
  *   Assembly is done by matching the previously segmented designators and outlines based on distance.
+ * - With --detections=<file>, the matched designator/outline pairs are also written as detection records
+ *   (JSON lines, or binary for a .bin file). Both records of a pair share the same id, the score is the normalised
+ *   template match score (1 for the outlines found as connected components).
+ * - With --auto, all thresholds above are chosen automatically and no windows are shown: the template thresholds
+ *   from the distribution of the scores, the outline threshold from the valley in the grayscale histogram and the
+ *   minimum outline area by clustering the areas of the connected components. Without --auto, the trackbars start
+ *   at the automatic values, so usually only a small correction is needed.
+ *   Use --output=<file> to save the assembled PCB.
+ * - The trackbar windows work on a preview of at most --preview pixels (default 1280) wide or high, with the morphology
+ *   kernels scaled along, so tuning stays responsive on large panel images. Every stage runs once on the full
+ *   resolution image when the user presses 'n'.
+ * - With --tile=<size>, the board is processed in tiles of size x size pixels, in parallel, with automatic thresholds.
+ *   The tiles overlap by the template size and the morphology kernels, template matches and outlines that cross a
+ *   tile seam are merged, so the result is the same as without tiles. Together with --cache (the decoded board is
+ *   then memory-mapped), the memory used does not grow with the size of the scan.
+ * - With --panel, the image is a production panel with a grid of identical boards. The repeat pitch is found from the
+ *   autocorrelation of the panel and every board is registered against the board in the middle of the grid. Only that
+ *   board goes through the stages above (with a margin, so nothing on its edge is cut off), its detections are copied
+ *   to the other boards and only checked there by comparing the image patches. Boards that do not match the reference
+ *   are skipped.
+ * - With --cache=<dir>, the decoded input images, the grayscale PCB image and the template score maps are kept in a
+ *   memory-mapped cache, so later runs on the same inputs skip decoding and template matching.
  *
  *
  *
@@ -30,7 +52,19 @@
 #include <cstdint>
 #include <utility>
 #include <math.h>
+#include <cfloat>
 #include <limits>
+#include <mutex>
+#include "common/auto_threshold.hpp"
+#include "common/detection_writer.hpp"
+#include "common/image_io.hpp"
+#include "common/image_utils.hpp"
+#include "common/mat_cache.hpp"
+#include "common/mat_pool.hpp"
+#include "common/ncc_matching.hpp"
+#include "common/panel.hpp"
+#include "common/template_matching.hpp"
+#include "common/tiling.hpp"
 
 using namespace std;
 using namespace cv;
@@ -38,48 +72,6 @@ using namespace cv;
 
 int tbThrTplVal = 70;
 
-/**
- * Helper function for reading in image files.
- * A message is displayed when the file could not be loaded, and the program is exited through exit().
- * @param destination OpenCV Mat to receive the image file contents.
- * @param path        Path to image.
- */
-void openImgFile(Mat &destination, const String &path)
-{
-    destination = imread(path, IMREAD_UNCHANGED);
-    if(destination.empty())
-    {
-        cerr << "Could not open " << path << endl;
-        exit(2);
-    }
-}
-
-/**
- * Helper function for copying one image into another, taking into account any transparant pixels.
- * These pixels are not coppied to the destination image.
- * @param dst  Destination image
- * @param src  Source image
- * @warn dst and src should have the same dimensions
- */
-void copyToTransparent(Mat &imgDst, Mat &imgSrc)
-{
-    Mat imgSrcBGR = Mat(imgSrc.rows, imgSrc.cols, CV_8UC3);
-    Mat imgSrcAlpha = Mat(imgSrc.rows, imgSrc.cols, CV_8UC1);
-    Mat out[] = {imgSrcBGR, imgSrcAlpha};
-    int from_to[] = {0, 0, 1, 1, 2, 2, 3, 3};
-    mixChannels(&imgSrc, 1, out, 2, from_to, 4);
-    for(int r = 0; r < imgDst.rows; r++)
-    {
-        for(int c = 0; c < imgDst.cols; c++)
-        {
-            if(imgSrcAlpha.at<uchar>(r, c) > 0)
-            {
-                imgDst.at<Vec3b>(r, c) = imgSrcBGR.at<Vec3b>(r, c);
-            }
-        }
-    }
-}
-
 /**
  * Helper function for getting the (approximate) center pixel of a rectangle
  * @param rect  The rectangle to get the center of
@@ -102,93 +94,85 @@ float getPixelDistance(Point p1, Point p2)
     return sqrt((p1.x - p2.x) * (p1.x - p2.x) + (p1.y - p2.y) * (p1.y - p2.y));
 }
 
-// Return the rotation matrices for each rotation
-// The angle parameter is expressed in degrees!
-//void rotate(Mat& src, double angle, Mat& dst)
-//{
-//    Point2f pt(src.cols/2., src.rows/2.);
-//    Mat r = getRotationMatrix2D(pt, angle, 1.0);
-//    warpAffine(src, dst, r, cv::Size(src.cols, src.rows));
-//}
-
-/**
- *
- * @param imgSearch  Image to search for template
- * @param imgTpl     Template image
- * @param thr        Threshold value for matched templates (must be 0.0 and 1.0 inclusive)
- * @return           Vector of bouding boxes of matched templates
- */
-vector<Rect> findTplMatches(Mat &imgSearch, Mat &imgTpl, float thr)
-{
-    Mat imgTmResult, ccLabels;
-    vector<Mat> imgTmResults;
-    int numComponents = 0;
-
-    vector<Rect> result;
-
-    if(thr > 1.0 || thr < 0.0)
-    {
-        throw domain_error("Threshold must be between 0.0 and 1.0 inclusive");
-    }
-
-
-    matchTemplate(imgSearch, imgTpl, imgTmResult, TM_CCORR_NORMED);
-    normalize(imgTmResult, imgTmResult, 0, 1.0, NORM_MINMAX, CV_32FC1);
-    threshold(imgTmResult, imgTmResult, thr, 255, THRESH_BINARY);
-
-    imgTmResult.convertTo(imgTmResult, CV_8UC1); // convert to CV_8UC1 type for connectedComponents()
-    numComponents = connectedComponents(imgTmResult, ccLabels, 8);
-    for(int i = 1; i < numComponents; i++)
-    {
-        Point maxLoc;
-        Mat imgMaskComponent;
-        Mat imgSearch;
-        /// maak masker voor de i-de gevonden component
-        inRange(ccLabels, i, i, imgMaskComponent);
-        /// pas masker toe op match map
-        imgSearch = imgTmResult & imgMaskComponent;
-        /// nu kunnen we minMaxLoc toepassen op de gemaskte afbeelding die enkel
-        /// de ene component bevat
-        minMaxLoc(imgSearch, nullptr, nullptr, nullptr, &maxLoc);
-        result.emplace_back(Rect(maxLoc, Size(imgTpl.cols, imgTpl.rows)));
-    }
-
-    return result;
-}
-
 /**
  * Find template matches in an interactive way.
  * The interaction is the displaying of a trackbar so that the user can set the threshold value for the template matching.
  * When the user presses the specified key, the currently displayed matches are returned.
+ * The score map is computed only once, moving the trackbar only extracts the matches again.
+ * While the trackbar is moved, the matches are extracted from a downscaled (max-pooled) score map and drawn on a
+ * downscaled image. When the user commits, the matches are extracted once from the full resolution score map.
  * @param imgSearch  Image to search for template
- * @param imgTpl     Template image
+ * @param scoreMap   Score map of the template in imgSearch, see computeTplScoreMap()
+ * @param tplSize    Size of the template
+ * @param thr        Initial threshold, e.g. from autoScoreThreshold(). It is kept as is until the trackbar is moved.
+ * @param scale      Scale of the preview, 1.0 to tune on the full resolution
  * @param title      String used for the title of the window
  * @param key        Keycode for the key that needs to be pressed by the user to continue
+ * @param scores     If not null, receives the score of every returned match
  * @return
  */
-vector<Rect> findTplMatchesInteractive(Mat &imgSearch, Mat &imgTpl, int key = 'n', String title = "")
+vector<Rect> findTplMatchesInteractive(Mat &imgSearch, const Mat &scoreMap, Size tplSize, float thr, double scale = 1.0,
+                                       int key = 'n', String title = "", vector<float> *scores = nullptr)
 {
     vector<Rect> matches;
-    Mat imgResult;
+    MatPool pool;
     String windowTitle = "Template matching: " + title;
+    PoolCounter counter(pool, windowTitle.c_str());
 
-    int tbTplThr = 75;
+    Mat imgPreview = imgSearch, scorePreview = scoreMap;
+    Size tplPreview = tplSize;
+    if(scale < 1.0)
+    {
+        resize(imgSearch, imgPreview, Size(), scale, scale, INTER_AREA);
+        downscaleMax(scoreMap, scale, scorePreview);
+        tplPreview = Size(max(cvRound(tplSize.width * scale), 1), max(cvRound(tplSize.height * scale), 1));
+    }
+
+    int tbTplThr = cvRound(thr * 100), tbTplThrInit = tbTplThr;
 
     namedWindow(windowTitle);
     createTrackbar("Template matching trackbar", windowTitle, &tbTplThr, 100, nullptr, nullptr);
     while(true)
     {
-        imgResult = imgSearch.clone();
-        matches = findTplMatches(imgSearch, imgTpl, tbTplThr / 100.0);
+        Mat imgResult = pool.copyOf(imgPreview);
+        if(tbTplThr != tbTplThrInit)
+            thr = tbTplThr / 100.0f;
+        matches = findTplMatches(scorePreview, tplPreview, thr, nullptr, &pool);
         for(const Rect &match : matches)
         {
             rectangle(imgResult, match, Scalar(255, 0, 0));
         }
         imshow(windowTitle, imgResult);
+        counter.iteration();
         if(waitKey(5) == key)
             break;
     }
-    return matches;
+    counter.print();
+    return scale < 1.0 || scores ? findTplMatches(scoreMap, tplSize, thr, scores) : matches;
+}
+
+/**
+ * Segment the component outlines: a gray-scale version of the board is thresholded to select only the silk screen and
+ * holes. Then the holes are removed by first eroding away all the thin (compared to the white holes) silk screen lines,
+ * dilating what remains (the holes) and masking it out.
+ * @param imgGS   Grayscale board, possibly a downscaled preview
+ * @param thr     Threshold for the silk screen
+ * @param scale   Scale of imgGS relative to the full resolution board, the morphology kernels are scaled with it
+ * @param imgThr  Receives the binary outline image
+ * @param pool    Scratch buffers
+ */
+void segmentOutlines(const Mat &imgGS, int thr, double scale, Mat &imgThr, MatPool &pool)
+{
+    // at full resolution: a 5x5 erosion applied twice (9x9) and a 5x5 dilation applied five times (21x21)
+    Mat erodeKernel = getStructuringElement(MORPH_RECT, Size(scaledKernelSize(9, scale), scaledKernelSize(9, scale)));
+    Mat dilateKernel = getStructuringElement(MORPH_RECT, Size(scaledKernelSize(21, scale), scaledKernelSize(21, scale)));
+    // erode and dilate into separate buffers: filtering in place makes OpenCV copy the source first
+    Mat imgTmp = pool.acquire(imgGS.size(), CV_8UC1), imgHoles = pool.acquire(imgGS.size(), CV_8UC1);
+    threshold(imgGS, imgThr, thr, 255, THRESH_BINARY);
+    erode(imgThr, imgTmp, erodeKernel);
+    dilate(imgTmp, imgHoles, dilateKernel);
+    bitwise_not(imgHoles, imgTmp);
+    bitwise_and(imgThr, imgTmp, imgThr);
 }
 
 /**
@@ -196,39 +180,300 @@ vector<Rect> findTplMatchesInteractive(Mat &imgSearch, Mat &imgTpl, int key = 'n
  * The rectangles in outlines are matched to the rectangles in designators by finding the closest matching designator for each outline
  * @param outlines(designators)
  * @param designators(outlines)
+ * @param closest  If not null, receives for every pair the index of the designator(outline) in designators, -1 if
+ *                 designators is empty, so the caller can look up its score
  * @return A vector of pairs, with the first element of the pair the outline(designator), and the second element the closest matched component designator(outline)
  */
-vector<pair<Rect, Rect> > getDesignatorOutlinePairs(vector<Rect> outlines, vector<Rect> designators)
+vector<pair<Rect, Rect> > getDesignatorOutlinePairs(vector<Rect> outlines, vector<Rect> designators,
+                                                    vector<int> *closest = nullptr)
 {
     vector<pair<Rect, Rect> > pairs; // store matches in vector of pairs
+    if(closest)
+        closest->clear();
     for(Rect outline : outlines)
     {
         Point centerOutline = getRectCenter(outline);
         float minDist = numeric_limits<float>::max();
         Rect rectClosestDesignator;
-        for(Rect designator : designators)
+        int indexClosestDesignator = -1;
+        for(size_t i = 0; i < designators.size(); i++)
         {
-            Point centerDesignator = getRectCenter(designator);
+            Point centerDesignator = getRectCenter(designators[i]);
             float dist = getPixelDistance(centerOutline, centerDesignator);
             {
                 if(dist < minDist)
                 {
                     minDist = dist;
-                    rectClosestDesignator = designator;
+                    rectClosestDesignator = designators[i];
+                    indexClosestDesignator = (int)i;
                 }
             }
         }
         pairs.emplace_back(pair<Rect, Rect>(outline, rectClosestDesignator));
+        if(closest)
+            closest->push_back(indexClosestDesignator);
     }
     return pairs;
 }
 
+/**
+ * Propagate the detections on the reference board of a panel to all boards.
+ * A detection belongs to the reference board if its center lies on it, the others are outside the board or in the
+ * margin around it. Every copy is verified by comparing its image patch with the patch on the reference board, so a
+ * missing or different component on one board is not reported.
+ * @param imgPcb         Panel image
+ * @param panel          Layout of the panel
+ * @param found          Detections on the reference board, relative to offset
+ * @param offset         Position of the analysed region of the reference board in the panel
+ * @param rejected       Incremented for every copy that failed the verification
+ * @param scores         If not null, the score of every detection in found, replaced by the scores of the returned
+ *                       detections (a copy keeps the score of the detection on the reference board)
+ * @param minSimilarity  Minimum patchSimilarity() of a copy
+ * @return               Detections on all boards, in panel coordinates
+ */
+vector<Rect> propagateToBoards(const Mat &imgPcb, const PanelLayout &panel, const vector<Rect> &found, Point offset,
+                               int &rejected, vector<float> *scores = nullptr, float minSimilarity = 0.5f)
+{
+    const Rect &reference = panel.boards[panel.reference];
+    Rect image(0, 0, imgPcb.cols, imgPcb.rows);
+    vector<Rect> propagated;
+    vector<float> propagatedScores;
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        Rect detection = found[i] + offset;
+        if(!reference.contains(getRectCenter(detection)))
+            continue;
+        for(size_t b = 0; b < panel.boards.size(); b++)
+        {
+            Rect copy = detection;
+            if((int)b != panel.reference)
+            {
+                copy = detection + (panel.boards[b].tl() - reference.tl());
+                if((copy & image) != copy || patchSimilarity(imgPcb(detection), imgPcb(copy)) < minSimilarity)
+                {
+                    rejected++;
+                    continue;
+                }
+            }
+            propagated.push_back(copy);
+            if(scores)
+                propagatedScores.push_back((*scores)[i]);
+        }
+    }
+    if(scores)
+        scores->swap(propagatedScores);
+    return propagated;
+}
+
+/**
+ * Raw NCC scores of a template for a rectangle of template positions, computed from the image region it covers.
+ * @param img     Board image
+ * @param tpl     Template
+ * @param out     Template positions (top-left corners), clipped to the valid positions
+ * @param scores  Receives the scores, empty if out is empty after clipping
+ */
+void tileScoreMap(const Mat &img, const Mat &tpl, Rect &out, Mat &scores)
+{
+    out &= Rect(0, 0, img.cols - tpl.cols + 1, img.rows - tpl.rows + 1);
+    if(out.area() <= 0)
+    {
+        scores.release();
+        return;
+    }
+    matchTemplateNcc(img(Rect(out.x, out.y, out.width + tpl.cols - 1, out.height + tpl.rows - 1)), tpl, scores);
+}
+
+/**
+ * Template matching and outline segmentation on a board that is too large to process at once, see TileGrid.
+ * The thresholds are chosen automatically, like with --auto, from histograms summed over the tiles. Three passes are
+ * made:
+ *  1. Per tile: the range and histogram of the raw template scores, and the histogram of the grayscale board.
+ *     The global range replaces the min-max normalisation of computeTplScoreMap().
+ *  2. Per tile: the peaks of the normalised score maps above the background level, and the outline segmentation and
+ *     connected components of the core of the tile. The template threshold splits the peaks of all tiles at the
+ *     largest gap between their scores, as autoScoreThreshold() does.
+ *  3. Per tile: the peaks of the normalised score maps above that threshold, which are the matches. Like
+ *     findTplMatches() on the whole board, every region above the final threshold gives one match, so neighbouring
+ *     designators whose regions only touch at the background level stay apart.
+ * A peak is kept by the tile whose core contains it. The score map of a tile covers its core grown by the template
+ * size, so a peak region that crosses a seam is seen whole by both tiles and reported once, as long as the region is
+ * not larger than the template. Regions above the final threshold are the tops of the match peaks and are much
+ * smaller, so the matches are the same as on the whole board. The components are joined across the seams by
+ * TiledComponents.
+ * @param imgPcb     Board image, preferably memory-mapped
+ * @param templates  Templates to match
+ * @param tileSize   Size of the tile cores
+ * @param matches    Receives the matches of every template
+ * @param matchScores  Receives the normalised score of every match
+ * @param outlines   Receives the component outlines
+ */
+void detectTiled(const Mat &imgPcb, const vector<Mat> &templates, int tileSize, vector<vector<Rect> > &matches,
+                 vector<vector<float> > &matchScores, vector<Rect> &outlines)
+{
+    const int rawBins = 1024;
+    const int morphHalo = 9 / 2 + 21 / 2; // radius of the erosion + dilation in segmentOutlines()
+    TileGrid grid(imgPcb.size(), tileSize);
+    size_t numTpl = templates.size();
+    mutex lock;
+
+    /** pass 1: histograms **/
+    vector<float> lo(numTpl, numeric_limits<float>::max()), hi(numTpl, -numeric_limits<float>::max());
+    vector<vector<double> > rawHist(numTpl, vector<double>(rawBins, 0.0));
+    vector<double> grayHist(256, 0.0);
+    grid.forEach([&](const Tile &tile)
+    {
+        Mat gray;
+        vector<double> tileGrayHist(256, 0.0);
+        cvtColor(imgPcb(tile.core), gray, COLOR_BGR2GRAY);
+        for(int r = 0; r < gray.rows; r++)
+            for(int c = 0; c < gray.cols; c++)
+                tileGrayHist[gray.ptr<uchar>(r)[c]]++;
+
+        vector<float> tileLo(numTpl), tileHi(numTpl);
+        vector<vector<double> > tileRawHist(numTpl, vector<double>(rawBins, 0.0));
+        for(size_t t = 0; t < numTpl; t++)
+        {
+            Rect out = tile.core;
+            Mat scores;
+            tileScoreMap(imgPcb, templates[t], out, scores);
+            tileLo[t] = numeric_limits<float>::max();
+            tileHi[t] = -numeric_limits<float>::max();
+            for(int r = 0; r < scores.rows; r++)
+                for(int c = 0; c < scores.cols; c++)
+                {
+                    float v = scores.ptr<float>(r)[c];
+                    tileLo[t] = min(tileLo[t], v);
+                    tileHi[t] = max(tileHi[t], v);
+                    tileRawHist[t][min(max((int)(v * rawBins), 0), rawBins - 1)]++;
+                }
+        }
+
+        lock_guard<mutex> guard(lock);
+        for(int b = 0; b < 256; b++)
+            grayHist[b] += tileGrayHist[b];
+        for(size_t t = 0; t < numTpl; t++)
+        {
+            lo[t] = min(lo[t], tileLo[t]);
+            hi[t] = max(hi[t], tileHi[t]);
+            for(int b = 0; b < rawBins; b++)
+                rawHist[t][b] += tileRawHist[t][b];
+        }
+    });
+
+    // histogram of the normalised scores, from the raw histogram and the global range
+    vector<float> background(numTpl);
+    for(size_t t = 0; t < numTpl; t++)
+    {
+        vector<double> hist(SCORE_BINS, 0.0);
+        float range = max(hi[t] - lo[t], FLT_EPSILON);
+        for(int b = 0; b < rawBins; b++)
+        {
+            float normalised = ((b + 0.5f) / rawBins - lo[t]) / range;
+            hist[min(max(cvRound(normalised * (SCORE_BINS - 1)), 0), SCORE_BINS - 1)] += rawHist[t][b];
+        }
+        background[t] = scoreBackgroundLevel(hist);
+    }
+    int outlineThr = grayThreshold(grayHist);
+    cout << "Tiled: " << grid.tiles().size() << " tiles, automatic outline threshold " << outlineThr << endl;
+
+    // normalised score map of a template on the core of a tile grown by the template size, and its peaks above thr
+    // that lie in the core
+    auto tilePeaks = [&](const Tile &tile, size_t t, float thr, vector<Rect> &found, vector<float> &foundScores)
+    {
+        const Mat &tpl = templates[t];
+        int margin = max(tpl.cols, tpl.rows);
+        Rect out = grid.withHalo(tile, margin);
+        Mat scores;
+        tileScoreMap(imgPcb, tpl, out, scores);
+        if(scores.empty())
+            return;
+        float range = max(hi[t] - lo[t], FLT_EPSILON);
+        scores.convertTo(scores, CV_32F, 1.0 / range, -lo[t] / range);
+
+        vector<Point> peaks;
+        vector<float> peakScores;
+        findPeaks(scores, thr, peaks, &peakScores);
+        for(size_t i = 0; i < peaks.size(); i++)
+        {
+            Point position = peaks[i] + out.tl();
+            if(!tile.core.contains(position))
+                continue;
+            found.emplace_back(position, tpl.size());
+            foundScores.push_back(peakScores[i]);
+        }
+    };
+
+    /** pass 2: peaks above the background and components **/
+    vector<vector<float> > candidateScores(numTpl);
+    TiledComponents components(grid);
+    grid.forEach([&](const Tile &tile)
+    {
+        vector<vector<Rect> > tileCandidates(numTpl);
+        vector<vector<float> > tileScores(numTpl);
+        for(size_t t = 0; t < numTpl; t++)
+            tilePeaks(tile, t, background[t], tileCandidates[t], tileScores[t]);
+
+        Rect halo = grid.withHalo(tile, morphHalo);
+        Mat gray, binary;
+        MatPool pool;
+        cvtColor(imgPcb(halo), gray, COLOR_BGR2GRAY);
+        segmentOutlines(gray, outlineThr, 1.0, binary, pool);
+        components.add(tile, binary(Rect(tile.core.tl() - halo.tl(), tile.core.size())).clone());
+
+        lock_guard<mutex> guard(lock);
+        for(size_t t = 0; t < numTpl; t++)
+            candidateScores[t].insert(candidateScores[t].end(), tileScores[t].begin(), tileScores[t].end());
+    });
+    vector<float> thresholds(numTpl);
+    for(size_t t = 0; t < numTpl; t++)
+        thresholds[t] = scoreGapThreshold(candidateScores[t], background[t]);
+
+    /** pass 3: matches above the template thresholds **/
+    matches.assign(numTpl, vector<Rect>());
+    matchScores.assign(numTpl, vector<float>());
+    grid.forEach([&](const Tile &tile)
+    {
+        vector<vector<Rect> > tileMatches(numTpl);
+        vector<vector<float> > tileScores(numTpl);
+        for(size_t t = 0; t < numTpl; t++)
+            tilePeaks(tile, t, thresholds[t], tileMatches[t], tileScores[t]);
+
+        lock_guard<mutex> guard(lock);
+        for(size_t t = 0; t < numTpl; t++)
+        {
+            matches[t].insert(matches[t].end(), tileMatches[t].begin(), tileMatches[t].end());
+            matchScores[t].insert(matchScores[t].end(), tileScores[t].begin(), tileScores[t].end());
+        }
+    });
+    for(size_t t = 0; t < numTpl; t++)
+        cout << "Tiled: template " << t << ": threshold " << thresholds[t] << ", " << matches[t].size() << " matches" << endl;
+
+    vector<int> areas;
+    vector<Rect> boxes;
+    components.merge(areas, boxes);
+    vector<int> sortedAreas(areas);
+    sort(sortedAreas.begin(), sortedAreas.end());
+    int minArea = autoAreaThreshold(sortedAreas);
+    outlines.clear();
+    for(size_t i = 0; i < areas.size(); i++)
+        if(areas[i] >= minArea)
+            outlines.push_back(boxes[i]);
+    cout << "Tiled: " << areas.size() << " components, minimum outline area " << minArea << ", " << outlines.size()
+         << " outlines" << endl;
+}
 
 int main(int argc, char *argv[])
 {
     const String keys("{help h usage ? |<none>| print this message}"
                       "{@img_pcb        |<none>| path to image of PCB}"
-                      "{@tpl_dir        |<none>| path to folder containing templates}");
+                      "{@tpl_dir        |<none>| path to folder containing templates}"
+                      "{detections d    |      | write the designator/outline pairs as JSON lines (.json, .jsonl) or binary records (.bin)}"
+                      "{cache           |      | directory for the memory-mapped cache of decoded images and score maps}"
+                      "{auto a          |      | choose all thresholds automatically instead of with trackbars}"
+                      "{output o        |      | write the assembled PCB image to this file}"
+                      "{preview         |1280  | tune on a preview of at most this many pixels wide/high, 0 for the full resolution}"
+                      "{panel p         |      | the image is a step-and-repeat panel: analyse one board and propagate the results to the other boards}"
+                      "{tile            |0     | process the board in tiles of this size (pixels), for scans too large to process at once; implies --auto}");
     CommandLineParser cmdParser(argc, argv, keys);
     String pathImgPcb, pathTplDir;
     Mat imgPcb, imgTplC, imgTplR, imgTplROutline, imgTplL;
@@ -237,6 +482,13 @@ int main(int argc, char *argv[])
 
     pathImgPcb = cmdParser.get<String>("@img_pcb");
     pathTplDir = cmdParser.get<String>("@tpl_dir");
+    String pathDetections = cmdParser.get<String>("detections");
+    String pathOutput = cmdParser.get<String>("output");
+    bool autoThr = cmdParser.has("auto");
+    int maxPreview = cmdParser.get<int>("preview");
+    int tileSize = cmdParser.get<int>("tile");
+    bool panelMode = cmdParser.has("panel");
+    autoThr = autoThr || tileSize > 0;
 
     if(!cmdParser.check())
     {
@@ -245,95 +497,206 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    openImgFile(imgPcb, pathImgPcb);
-    openImgFile(imgTplR, pathTplDir + "/R.jpg");
-    openImgFile(imgTplROutline, pathTplDir + "/R_outline.jpg");
-    openImgFile(imgTplC, pathTplDir + "/C.jpg");
-    openImgFile(imgResistor, pathTplDir + "/resistor.png");
-    openImgFile(imgCapacitor, pathTplDir + "/capacitor.png");
+    // all input images are decoded in parallel, or mapped from the cache
+    MatCache cache(cmdParser.get<String>("cache"));
+    String pathTplR = pathTplDir + "/R.jpg", pathTplROutline = pathTplDir + "/R_outline.jpg", pathTplC = pathTplDir + "/C.jpg";
+    openImgFiles({pathImgPcb, pathTplR, pathTplROutline, pathTplC, pathTplDir + "/resistor.png", pathTplDir + "/capacitor.png"},
+                 {&imgPcb, &imgTplR, &imgTplROutline, &imgTplC, &imgResistor, &imgCapacitor}, IMREAD_UNCHANGED, 1, &cache);
+    if(tileSize > 0 && !cache.enabled())
+        cerr << "Warning: without --cache the whole board is kept in memory, only the processing is tiled" << endl;
+
+    enum { CLASS_R, CLASS_R_OUTLINE, CLASS_C, CLASS_C_OUTLINE };
+    DetectionWriter detections;
+    if(!pathDetections.empty() && !detections.open(pathDetections, {"R", "R_outline", "C", "C_outline"}))
+    {
+        cerr << "Could not create " << pathDetections << endl;
+        return 2;
+    }
+    int pairId = 0;
 
 
+    /** step-and-repeat panel: only the reference board is analysed, see propagateToBoards() **/
+    Mat imgBoard = imgPcb;
+    Rect boardRegion(0, 0, imgPcb.cols, imgPcb.rows);
+    String keyPcb = cache.fileKey(pathImgPcb);
+    PanelLayout panel;
+    if(panelMode)
+    {
+        panel = findPanelLayout(imgPcb);
+        cout << "Panel: pitch " << panel.pitch.width << "x" << panel.pitch.height << ", " << panel.boards.size()
+             << " boards, " << panel.rejected << " grid cells rejected" << endl;
+        // with a margin, so the templates and outlines on the edge of the reference board are found whole
+        int margin = max({imgTplR.cols, imgTplR.rows, imgTplROutline.cols, imgTplROutline.rows, imgTplC.cols, imgTplC.rows}) + 21;
+        const Rect &reference = panel.boards[panel.reference];
+        boardRegion = Rect(reference.x - margin, reference.y - margin, reference.width + 2 * margin,
+                           reference.height + 2 * margin) & boardRegion;
+        imgBoard = imgPcb(boardRegion);
+        keyPcb += "/board/" + to_string(boardRegion.x) + "_" + to_string(boardRegion.y) + "_" +
+                  to_string(boardRegion.width) + "x" + to_string(boardRegion.height);
+    }
+
     /** template matching for component designators (R, C, D) and R outlines **/
     vector<Rect> matchesR, matchesROutline, matchesC;
-    matchesR = findTplMatchesInteractive(imgPcb, imgTplR, 'n', "Resistors");
-    matchesROutline = findTplMatchesInteractive(imgPcb, imgTplROutline, 'n', "Resistors Outline");
-    matchesC = findTplMatchesInteractive(imgPcb, imgTplC, 'n', "Capacitors");
-
-    /** Use connected component analysis to find the outlines of other components (C, D) **/
-    Mat imgGS; // grasycale version of input image
-    Mat imgThr, imgThrMorph; // will hold thresholded, and eroded/dilated version of thresholded input image
+    vector<float> scoresMatchR, scoresMatchROutline, scoresMatchC;
     vector<Rect> otherOutlines;
-    Mat morphKernel = getStructuringElement(MORPH_RECT, Size(5, 5));
-    namedWindow("Filtered Holes Result");
-    int tbOutlineThr = 200;
-
-    // Let user play with threshold values to filter out PCB holes
-    // A gray-scale version of the original image is thresholded to select only the silk screen and holes.
-    // Then the holes are removed by first eroding away all the thin(compared to the white holes) silk screen lines
-    // Alternative: use template matching on holes
-    GaussianBlur(imgGS, imgGS, Size(3, 3),
-                 0.0); // Add some blur, which will have extra affect of removing noise (especially in combination with the erosion applied below)
-    cvtColor(imgPcb, imgGS, COLOR_BGR2GRAY);
-    createTrackbar("Outline Threshold Trackbar", "Filtered Holes Result", &tbOutlineThr, 255, nullptr, nullptr);
-    while(true)
+    // the trackbars work on a downscaled preview, every stage runs on the full resolution once the user commits
+    double scale = maxPreview > 0 ? previewScale(imgBoard.size(), maxPreview) : 1.0;
+    if(tileSize > 0)
     {
-        threshold(imgGS, imgThr, tbOutlineThr, 255, THRESH_BINARY);
-        erode(imgThr, imgThrMorph, morphKernel, Point(-1, -1), 2);
-        dilate(imgThrMorph, imgThrMorph, morphKernel, Point(-1, -1), 5);
-        imgThr = imgThr & ~imgThrMorph;
-        imshow("Filtered Holes Result", imgThr);
-
-        if(waitKey(5) == 'n')
-            break;
+        // large panel scans: the same stages, tile by tile and with automatic thresholds
+        vector<vector<Rect> > matches;
+        vector<vector<float> > matchScores;
+        detectTiled(imgBoard, {imgTplR, imgTplROutline, imgTplC}, tileSize, matches, matchScores, otherOutlines);
+        matchesR = matches[0];
+        matchesROutline = matches[1];
+        matchesC = matches[2];
+        scoresMatchR = matchScores[0];
+        scoresMatchROutline = matchScores[1];
+        scoresMatchC = matchScores[2];
     }
-
-    // Now let the user play with trackbar to select outlines by area. Only relatively large connected
-    // components are outlines, so the user should select a sufficiently large value.
-    Mat ccLabels, ccStats, ccCentroids;
-    int maxArea, tbCCAreaThr;
-    vector<int> ccAreas;
-
-    namedWindow("CC Area Result");
-    int numComponents = connectedComponentsWithStats(imgThr, ccLabels, ccStats, ccCentroids);
-    for(int i = 1; i < numComponents; i++)
-        ccAreas.push_back(ccStats.at<int>(i, CC_STAT_AREA));
-    sort(ccAreas.begin(), ccAreas.end());
-    for(int area : ccAreas)
-        cout << area << endl;
-    createTrackbar("CC Area Threshold Trackbar", "CC Area Result", &tbCCAreaThr, ccAreas.back(), nullptr, nullptr);
-    while(true)
+    else
     {
-        Mat ccResult = imgPcb.clone();
-        otherOutlines.clear();
+        Mat scoresR, scoresROutline, scoresC;
+        cache.getOrCompute(keyPcb + "/tplscore/" + cache.fileKey(pathTplR), scoresR,
+                           [&](Mat &m) { computeTplScoreMap(imgBoard, imgTplR, m); });
+        cache.getOrCompute(keyPcb + "/tplscore/" + cache.fileKey(pathTplROutline), scoresROutline,
+                           [&](Mat &m) { computeTplScoreMap(imgBoard, imgTplROutline, m); });
+        cache.getOrCompute(keyPcb + "/tplscore/" + cache.fileKey(pathTplC), scoresC,
+                           [&](Mat &m) { computeTplScoreMap(imgBoard, imgTplC, m); });
+        Mat imgPreview = imgBoard;
+        if(scale < 1.0)
+            resize(imgBoard, imgPreview, Size(), scale, scale, INTER_AREA);
+
+        // the automatic threshold is used directly, or as the starting point of the trackbar
+        auto matchTpl = [&](const Mat &scoreMap, Size tplSize, const String &title, vector<float> &matchScores)
+        {
+            float thr = autoScoreThreshold(scoreMap);
+            cout << title << ": automatic template threshold " << thr << endl;
+            if(autoThr)
+                return findTplMatches(scoreMap, tplSize, thr, &matchScores);
+            return findTplMatchesInteractive(imgBoard, scoreMap, tplSize, thr, scale, 'n', title, &matchScores);
+        };
+        matchesR = matchTpl(scoresR, imgTplR.size(), "Resistors", scoresMatchR);
+        matchesROutline = matchTpl(scoresROutline, imgTplROutline.size(), "Resistors Outline", scoresMatchROutline);
+        matchesC = matchTpl(scoresC, imgTplC.size(), "Capacitors", scoresMatchC);
+
+        /** Use connected component analysis to find the outlines of other components (C, D) **/
+        Mat imgGS; // grasycale version of input image
+        Mat imgThr; // will hold the thresholded input image with the holes removed
+        MatPool pool; // scratch buffers of the trackbar loops below, reused on every iteration
+
+        // Let user play with threshold values to filter out PCB holes, see segmentOutlines()
+        // Alternative: use template matching on holes
+        GaussianBlur(imgGS, imgGS, Size(3, 3),
+                     0.0); // Add some blur, which will have extra affect of removing noise (especially in combination with the erosion applied below)
+        cache.getOrCompute(keyPcb + "/gray", imgGS, [&](Mat &m) { cvtColor(imgBoard, m, COLOR_BGR2GRAY); });
+        // the silk screen and holes are the bright mode of the histogram, the board the dark mode
+        int tbOutlineThr = autoGrayThreshold(imgGS);
+        cout << "Automatic outline threshold " << tbOutlineThr << endl;
+        if(!autoThr)
+        {
+            Mat imgGSPreview = imgGS, imgThrPreview;
+            if(scale < 1.0)
+                resize(imgGS, imgGSPreview, Size(), scale, scale, INTER_AREA);
+            namedWindow("Filtered Holes Result");
+            createTrackbar("Outline Threshold Trackbar", "Filtered Holes Result", &tbOutlineThr, 255, nullptr, nullptr);
+            PoolCounter outlineCounter(pool, "Filtered Holes Result");
+            while(true)
+            {
+                segmentOutlines(imgGSPreview, tbOutlineThr, scale, imgThrPreview, pool);
+                imshow("Filtered Holes Result", imgThrPreview);
+                outlineCounter.iteration();
+
+                if(waitKey(5) == 'n')
+                    break;
+            }
+            outlineCounter.print();
+        }
+        segmentOutlines(imgGS, tbOutlineThr, 1.0, imgThr, pool);
+
+        // Now let the user play with trackbar to select outlines by area. Only relatively large connected
+        // components are outlines, so the user should select a sufficiently large value.
+        Mat ccLabels, ccStats, ccCentroids;
+        int maxArea, tbCCAreaThr;
+        vector<int> ccAreas;
+
+        int numComponents = connectedComponentsWithStats(imgThr, ccLabels, ccStats, ccCentroids);
         for(int i = 1; i < numComponents; i++)
+            ccAreas.push_back(ccStats.at<int>(i, CC_STAT_AREA));
+        sort(ccAreas.begin(), ccAreas.end());
+        for(int area : ccAreas)
+            cout << area << endl;
+        tbCCAreaThr = autoAreaThreshold(ccAreas);
+        cout << "Automatic minimum outline area " << tbCCAreaThr << endl;
+        // the components are analysed once at full resolution (areas in full resolution pixels),
+        // the trackbar only selects from them and draws the selection on the preview
+        auto selectOutlines = [&](int minArea, vector<Rect> &outlines)
         {
-            Mat tmp = ccLabels.clone();
-            if(ccStats.at<int>(i, CC_STAT_AREA) < tbCCAreaThr)
-                continue;
+            outlines.clear();
+            for(int i = 1; i < numComponents; i++)
+            {
+                if(ccStats.at<int>(i, CC_STAT_AREA) < minArea)
+                    continue;
 
-            inRange(tmp, i, i, tmp);
-            Rect bRect = boundingRect(tmp);
-            otherOutlines.emplace_back(bRect);
-            rectangle(ccResult, bRect, Scalar(255, 0, 255));
+                // the bounding box of every component is already in the stats, no need to mask the label image
+                outlines.emplace_back(ccStats.at<int>(i, CC_STAT_LEFT), ccStats.at<int>(i, CC_STAT_TOP),
+                                      ccStats.at<int>(i, CC_STAT_WIDTH), ccStats.at<int>(i, CC_STAT_HEIGHT));
+            }
+        };
+        if(!autoThr && !ccAreas.empty())
+        {
+            namedWindow("CC Area Result");
+            createTrackbar("CC Area Threshold Trackbar", "CC Area Result", &tbCCAreaThr, ccAreas.back(), nullptr, nullptr);
+            PoolCounter ccCounter(pool, "CC Area Result");
+            while(true)
+            {
+                Mat ccResult = pool.copyOf(imgPreview);
+                selectOutlines(tbCCAreaThr, otherOutlines);
+                for(const Rect &outline : otherOutlines)
+                    rectangle(ccResult, scaleRect(outline, scale), Scalar(255, 0, 255));
+                imshow("CC Area Result", ccResult);
+                ccCounter.iteration();
+                if(waitKey(5) == 'n')
+                    break;
+            }
+            ccCounter.print();
         }
-        imshow("CC Area Result", ccResult);
-        if(waitKey(5) == 'n')
-            break;
+        selectOutlines(tbCCAreaThr, otherOutlines);
+    }
+
+    if(panelMode)
+    {
+        int rejected = 0;
+        matchesR = propagateToBoards(imgPcb, panel, matchesR, boardRegion.tl(), rejected, &scoresMatchR);
+        matchesROutline = propagateToBoards(imgPcb, panel, matchesROutline, boardRegion.tl(), rejected, &scoresMatchROutline);
+        matchesC = propagateToBoards(imgPcb, panel, matchesC, boardRegion.tl(), rejected, &scoresMatchC);
+        otherOutlines = propagateToBoards(imgPcb, panel, otherOutlines, boardRegion.tl(), rejected);
+        cout << "Panel: " << rejected << " propagated detections rejected" << endl;
     }
 
+    // the detection records carry the template match scores; the outlines of C and D are connected components
+    // without a score, they get 1
+    auto closestScore = [](const vector<float> &scores, int closest) { return closest >= 0 ? scores[closest] : 0.0f; };
 
     /** match Resistor designators ('R' on the silkscreen) with nearest by Resistor outlines **/
-    vector<pair<Rect, Rect> > pairsR = getDesignatorOutlinePairs(matchesROutline, matchesR);
+    vector<int> closestR;
+    vector<pair<Rect, Rect> > pairsR = getDesignatorOutlinePairs(matchesROutline, matchesR, &closestR);
 
-    imgResult = imgPcb.clone();
-    for(pair<Rect, Rect> pairR : pairsR)
+    // in tiled mode the board itself is drawn on, a copy of a panel scan would double the memory
+    imgResult = tileSize > 0 ? imgPcb : imgPcb.clone();
+    for(size_t i = 0; i < pairsR.size(); i++)
     {
+        const pair<Rect, Rect> &pairR = pairsR[i];
         Mat imgDestResistor;
         resize(imgResistor, imgDestResistor, pairR.first.size());
         line(imgResult, getRectCenter(pairR.first), getRectCenter(pairR.second), Scalar(255, 0, 0), 2);
 
         Mat roiDst = imgResult(pairR.first);
         copyToTransparent(roiDst, imgDestResistor);
+
+        detections.write(Detection(0, CLASS_R_OUTLINE, pairR.first, scoresMatchROutline[i], pairId));
+        detections.write(Detection(0, CLASS_R, pairR.second, closestScore(scoresMatchR, closestR[i]), pairId));
+        pairId++;
     }
 
 
@@ -341,9 +704,11 @@ int main(int argc, char *argv[])
     // We match the matched designators with the outlines, as opposed to above, where we match the outlines with the resistors!
     // (By switching around the parameters to getDesignatorOutlinePairs())
     // (Because of this, the items in the pair vector are switched (first <-> second))
-    vector<pair<Rect, Rect> > pairsC = getDesignatorOutlinePairs(matchesC, otherOutlines);
-    for(pair<Rect, Rect> pairC : pairsC)
+    vector<int> closestC;
+    vector<pair<Rect, Rect> > pairsC = getDesignatorOutlinePairs(matchesC, otherOutlines, &closestC);
+    for(size_t i = 0; i < pairsC.size(); i++)
     {
+        const pair<Rect, Rect> &pairC = pairsC[i];
         Mat imgDestCapacitor;
 
         imgDestCapacitor = imgCapacitor.clone();
@@ -359,10 +724,28 @@ int main(int argc, char *argv[])
 
         Mat roiDst = imgResult(pairC.second);
         copyToTransparent(roiDst, imgDestCapacitor);
+
+        detections.write(Detection(0, CLASS_C, pairC.first, scoresMatchC[i], pairId));
+        detections.write(Detection(0, CLASS_C_OUTLINE, pairC.second, closestC[i] >= 0 ? 1.0f : 0.0f, pairId));
+        pairId++;
     }
 
-    imshow("Final Result", imgResult);
-    waitKey(0);
+    detections.close();
+
+    if(!pathOutput.empty() && !imwrite(pathOutput, imgResult))
+    {
+        cerr << "Could not write " << pathOutput << endl;
+        return 2;
+    }
+    if(!autoThr)
+    {
+        Mat imgShow = imgResult;
+        double showScale = maxPreview > 0 ? previewScale(imgResult.size(), maxPreview) : 1.0;
+        if(showScale < 1.0)
+            resize(imgResult, imgShow, Size(), showScale, showScale, INTER_AREA);
+        imshow("Final Result", imgShow);
+        waitKey(0);
+    }
 }
 
 
@@ -1,12 +1,18 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <unistd.h>
+#include "common/detection_writer.hpp"
+#include "common/image_io.hpp"
+#include "common/image_utils.hpp"
+#include "common/mat_pool.hpp"
 
 using namespace std;
 using namespace cv;
 
 const String keys("{help h usage ? | | print this message }"
-                  "{@image         | | image file}");
+                  "{@image         | | image file}"
+                  "{detections     | | on exit, write the convex hull as a JSON line (.json) or binary record (.bin)}"
+                  "{preview        |1024| tune on a preview of at most this many pixels wide/high, 0 for the full resolution}");
 int th_val_h_upper = 160, th_val_h_lower = 10, th_val_s = 240;
 int update_cc = 0;
 
@@ -41,14 +47,14 @@ int main(int argc, char * argv[])
     printf("cwd: %s\n", path);
     String imgpath = parser.get<String>("@image");
 
-    img = imread(imgpath);
-    if(img.empty())
-    {
-        cout <<  "Could not open or find the image with path '" + imgpath + "'" << std::endl ;
-        return -1;
-    }
-    //resize(img, img, Size(img.cols/2, img.rows/2));
-    imshow("Oorspronkelijke afbeelding", img);
+    openImgFile(img, imgpath, IMREAD_COLOR);
+    // de trackbars werken op een verkleinde preview, de volle resolutie wordt enkel bij het afsluiten verwerkt
+    int max_preview = parser.get<int>("preview");
+    double schaal = max_preview > 0 ? previewScale(img.size(), max_preview) : 1.0;
+    Mat img_preview = img;
+    if(schaal < 1.0)
+        resize(img, img_preview, Size(), schaal, schaal, INTER_AREA);
+    imshow("Oorspronkelijke afbeelding", img_preview);
 
 
 
@@ -93,8 +99,12 @@ int main(int argc, char * argv[])
     {
         printf("ERROR: %s\n", e.what());
     }
-    vector<Mat> channels_hsv;
+    vector<Mat> channels_hsv, channels_hsv_preview;
     split(img_hsv, channels_hsv);
+    channels_hsv_preview = channels_hsv;
+    if(schaal < 1.0)
+        for(Mat &kanaal : channels_hsv_preview)
+            resize(kanaal, kanaal, Size(), schaal, schaal, INTER_NEAREST); // nearest: hue mag niet uitgemiddeld worden
 
     Mat h_mask, h_mask_1, h_mask_2, s_mask, result_mask;
     /* Trackbars voor gebruikerinput. De gebruiker kan het interval voor de Hue dimensie kiezen, alsook
@@ -104,84 +114,131 @@ int main(int argc, char * argv[])
     createTrackbar("Upper H thresh", "H thresh", &th_val_h_upper, 180, on_trackbar_h_upper, NULL);
     createTrackbar("Lower H thresh", "H thresh", &th_val_h_lower, 180, on_trackbar_h_lower, NULL);
     createTrackbar("S thresh", "S thresh", &th_val_s, 255, on_trackbar_s, NULL);
-    while(true)
+    /// convex hull van het laatst getoonde resultaat
+    vector<Point> hull;
+    /// buffers en contours worden elke iteratie hergebruikt i.p.v. opnieuw gealloceerd
+    MatPool pool;
+    PoolCounter counter(pool, "Resultaat");
+    // 10x dilatie/erosie met een 3x3 kernel = 1x met een 21x21 kernel, mee geschaald met de preview
+    Mat kernel_preview = getStructuringElement(MORPH_RECT, Size(scaledKernelSize(21, schaal), scaledKernelSize(21, schaal)));
+    vector<vector<Point> > contours;
+    vector<Vec4i> hierarchy;
+
+    /**
+     * Segmenteer het verkeersbord en bepaal de convex hull van de grootste contour
+     * @param kanalen  HSV kanalen van de (preview) afbeelding
+     * @param kernel   Kernel voor dilatie-erosie, geschaald naar de afbeelding
+     * @param toon     Toon de tussenresultaten
+     * @return         false als er geen contour gevonden is
+     */
+    auto segmenteer = [&](const vector<Mat> &kanalen, const Mat &kernel, bool toon)
     {
-        // druk q om af te sluiten
-        if(waitKey(2) == 'q')
-            return 0;
         // Segmenteer pixels obv Hue
-        inRange(channels_hsv[0], 0, th_val_h_lower, h_mask_1);
-        inRange(channels_hsv[0], th_val_h_upper, 180, h_mask_2);
+        inRange(kanalen[0], 0, th_val_h_lower, h_mask_1);
+        inRange(kanalen[0], th_val_h_upper, 180, h_mask_2);
         // segmenteer pixels obv Saturation
-        inRange(channels_hsv[1], th_val_s, 255, s_mask);
+        inRange(kanalen[1], th_val_s, 255, s_mask);
         h_mask = h_mask_1 | h_mask_2;
-        imshow("H thresh", h_mask);
-        imshow("S thresh", s_mask);
         // Maak combinatie masker van hue en saturation segmentatie
         result_mask = h_mask & s_mask;
-        imshow("H+S masker", result_mask);
-
-        // Pas dilatie-erosie toe om kleine "rommel" op te kuisen
-        Mat diler_kernel = getStructuringElement(MORPH_RECT, Size(3, 3));
-        dilate(result_mask, result_mask, diler_kernel, Point(-1, -1), 10);
-        erode(result_mask, result_mask, diler_kernel, Point(-1, -1), 10);
-        imshow("H+S masker na dilatie-erosie", result_mask);
-
-
-        /*** Connected components analyse met connectedComponents() ***/
-        /*
-        if(update_cc)
+        if(toon)
         {
-            update_cc = 0;
-            Mat ccLabels;
-            int nLabels = 0;
-
-            nLabels = connectedComponents(result_mask, ccLabels, 8);
-            std::vector<Vec3b> cc_colors(nLabels);
-            cc_colors[0] = Vec3b(0, 0, 0);//background
-            for(int label = 1; label < nLabels; ++label)
-                cc_colors[label] = Vec3b( (rand()&255), (rand()&255), (rand()&255) );
-
-            Mat cc_result(result_mask.size(), CV_8UC3);
-            for(int r = 0; r < cc_result.rows; ++r){
-                for(int c = 0; c < cc_result.cols; ++c){
-                    int label = ccLabels.at<int>(r, c);
-                    Vec3b &pixel = cc_result.at<Vec3b>(r, c);
-                    pixel = cc_colors[label];
-                 }
-             }
-
-             imshow("Connected components result", cc_result);
+            imshow("H thresh", h_mask);
+            imshow("S thresh", s_mask);
+            imshow("H+S masker", result_mask);
         }
-        */
-
 
+        // Pas dilatie-erosie toe om kleine "rommel" op te kuisen
+        // (niet in place: dan kopieert OpenCV eerst de bron)
+        Mat dilated = pool.acquire(result_mask.size(), CV_8UC1);
+        dilate(result_mask, dilated, kernel);
+        erode(dilated, result_mask, kernel);
+        if(toon)
+            imshow("H+S masker na dilatie-erosie", result_mask);
 
         /*** Connected component analyse met findContours() ***/
-        vector<vector<Point> > contours;
-        vector<Vec4i> hierarchy;
-
         findContours(result_mask, contours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_NONE);
-        // loop over alle contours en vindt grootste
+        // loop over alle contours en vindt grootste (enkel de index, zonder de contour te kopiëren)
         // We gaan ervan uit dat dit het verkeersbord is
-        vector<Point> contour_grootste;
-        contour_grootste = contours[0];
-        for(int i = 0; i < contours.size(); i++)
+        int grootste = -1;
+        double area_grootste = -1;
+        for(int i = 0; i < (int)contours.size(); i++)
         {
-            if(contourArea(contours[i]) > contourArea(contour_grootste))
-                contour_grootste = contours[i];
+            double area = contourArea(contours[i]);
+            if(area > area_grootste)
+            {
+                grootste = i;
+                area_grootste = area;
+            }
         }
-        // convexHull rond grootste contour, dan tekenen met drawContours (stop eerst opnieuw in vector van vector van points)
-        vector<Point> hull;
-        convexHull(contour_grootste, hull);
+        if(grootste < 0)
+            return false;
+        convexHull(contours[grootste], hull);
+        return true;
+    };
 
-        vector< vector<Point> > tmp;
+    /*** Connected components analyse met connectedComponents() ***/
+    /*
+    if(update_cc)
+    {
+        update_cc = 0;
+        Mat ccLabels;
+        int nLabels = 0;
+
+        nLabels = connectedComponents(result_mask, ccLabels, 8);
+        std::vector<Vec3b> cc_colors(nLabels);
+        cc_colors[0] = Vec3b(0, 0, 0);//background
+        for(int label = 1; label < nLabels; ++label)
+            cc_colors[label] = Vec3b( (rand()&255), (rand()&255), (rand()&255) );
+
+        Mat cc_result(result_mask.size(), CV_8UC3);
+        for(int r = 0; r < cc_result.rows; ++r){
+            for(int c = 0; c < cc_result.cols; ++c){
+                int label = ccLabels.at<int>(r, c);
+                Vec3b &pixel = cc_result.at<Vec3b>(r, c);
+                pixel = cc_colors[label];
+             }
+         }
+
+         imshow("Connected components result", cc_result);
+    }
+    */
 
-        tmp.push_back(hull);
-        Mat result = img.clone();
-        drawContours(result, tmp, -1, Scalar(0, 255, 0), 3);
+    bool gevonden = false;
+    while(true)
+    {
+        // druk q om af te sluiten
+        if(waitKey(2) == 'q')
+            break;
+        // convexHull rond grootste contour, dan tekenen als gesloten polygoon
+        gevonden = segmenteer(channels_hsv_preview, kernel_preview, true);
+        Mat result = pool.copyOf(img_preview);
+        if(gevonden)
+            polylines(result, hull, true, Scalar(0, 255, 0), 3);
         imshow("Resultaat", result);
+        counter.iteration();
+
+    }
+    counter.print();
+
+    // de gekozen drempels eenmaal op volle resolutie toepassen
+    if(schaal < 1.0)
+        gevonden = segmenteer(channels_hsv, getStructuringElement(MORPH_RECT, Size(21, 21)), false);
+    if(!gevonden)
+        hull.clear();
 
+    /// resultaat wegschrijven: bounding box + hull als polygoon
+    String path_detections = parser.get<String>("detections");
+    if(!path_detections.empty() && !hull.empty())
+    {
+        DetectionWriter detections;
+        if(!detections.open(path_detections, {"sign"}))
+        {
+            cerr << "Could not create '" + path_detections + "'" << endl;
+            return -1;
+        }
+        vector<Point2f> polygon(hull.begin(), hull.end());
+        detections.write(Detection(0, 0, boundingRect(hull), 0, -1, polygon.data(), (int)polygon.size()));
     }
 
     return 0;
@@ -1,47 +1,18 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "common/detection_writer.hpp"
+#include "common/image_io.hpp"
+#include "common/image_utils.hpp"
+#include "common/nms.hpp"
+#include "common/template_matching.hpp"
 
 using namespace std;
 using namespace cv;
 
 const String keys("{help h    |            |print this message }"
                   "{@input    |recht.jpg   |input image}"
-                  "{@template |template.jpg|template image}");
-
-/**
- * Helper functie om input files in te lezen
- */
-static void input_open(vector<String> paths, vector<Mat*> pMats)
-{
-	size_t i;
-	if(paths.size() != pMats.size())
-	{
-		fprintf(stderr, "Error opening input files\n");
-		exit(1);
-	}
-	cerr << paths.size() << endl;
-	for(unsigned int i = 0; i < paths.size(); i++)
-	{
-		cerr << "Opening " << paths[i] << endl;
-		*(pMats[i]) = imread(paths[i]);
-		if((pMats[i])->empty())
-		{
-			fprintf(stderr, "Could not open input file %s\n", paths[i].c_str());
-			exit(1);
-		}
-
-	}
-
-}
-
-// Return the rotation matrices for each rotation
-// The angle parameter is expressed in degrees!
-void rotate(Mat& src, double angle, Mat& dst)
-{
-    Point2f pt(src.cols/2., src.rows/2.);
-    Mat r = getRotationMatrix2D(pt, angle, 1.0);
-    warpAffine(src, dst, r, cv::Size(src.cols, src.rows));
-}
+                  "{@template |template.jpg|template image}"
+                  "{detections|            |write the matches of c) and d) as JSON lines (.json) or binary records (.bin)}");
 
 int main(int argc, char * argv[])
 {
@@ -65,7 +36,17 @@ int main(int argc, char * argv[])
     	return 1;
     }
 
-    input_open({path_input, path_template}, {&img_input, &img_template});
+    openImgFiles({path_input, path_template}, {&img_input, &img_template});
+
+    /// matches van c) en d) als detectie records, score = genormaliseerde match waarde
+    enum { CLASS_MATCH, CLASS_MATCH_ROTATED };
+    DetectionWriter detections;
+    String path_detections = parser.get<String>("detections");
+    if(!path_detections.empty() && !detections.open(path_detections, {"match", "match_rotated"}))
+    {
+        fprintf(stderr, "Could not create output file %s\n", path_detections.c_str());
+        return 1;
+    }
 
 
     imshow("input", img_input);
@@ -94,16 +75,25 @@ int main(int argc, char * argv[])
     threshold(img_tm_result, img_mask, 0.96*255, 255, THRESH_BINARY);
     imshow("thresh", img_mask);
     Mat img_result_1 = img_input.clone();
+    /// elke pixel boven de threshold is een kandidaat, met non-maximum suppression blijft er 1 box per match over
+    vector<Rect> candidates, merged;
+    vector<float> candidate_scores;
+    vector<int> keep;
     for(int row = 0; row < img_mask.rows; row++)
     {
         for(int col = 0; col < img_mask.cols; col++)
         {
             if(img_mask.at<uchar>(row, col))
             {
-                rectangle(img_result_1, Point(col, row), Point(col + img_template.cols, row + img_template.rows), Scalar(0, 255, 0), 5);
+                candidates.emplace_back(Point(col, row), img_template.size());
+                candidate_scores.push_back(img_tm_result.at<uchar>(row, col));
             }
         }
     }
+    nonMaximumSuppression(candidates, candidate_scores, 0.3f, keep, &merged);
+    for(const Rect &match : merged)
+        rectangle(img_result_1, match, Scalar(0, 255, 0), 5);
+    cerr << candidates.size() << " pixels boven de threshold, " << merged.size() << " matches na NMS" << endl;
     imshow("Resultaat (1)", img_result_1);
 
     /** b) bounding box bij globaal maximum */
@@ -117,21 +107,14 @@ int main(int argc, char * argv[])
 
     /** c) bounding box bij lokale maxima **/
     Mat img_result_3 = img_input.clone();
-    Mat img_labels;
-    /// detecteer components (regios > threshold) waarbinnen locale minmax gezocht moeten worden
-    int num_components = connectedComponents(img_mask, img_labels, 8);
-    for(int i = 0; i < num_components; i++)
+    /// per component (regio > threshold) het lokale maximum zoeken
+    vector<Point> peaks;
+    vector<float> peak_values;
+    findPeaks(img_tm_result, 0.96*255, peaks, &peak_values);
+    for(size_t i = 0; i < peaks.size(); i++)
     {
-        Mat img_mask_component;
-        Mat img_search;
-        /// maak masker voor de i-de gevonden component
-        inRange(img_labels, i, i, img_mask_component);
-        /// pas masker toe op match map
-        img_search = img_tm_result & img_mask_component;
-        /// nu kunnen we minMaxLoc toepassen op de gemaskte afbeelding die enkel
-        /// de ene component bevat
-        minMaxLoc(img_search, NULL, NULL, NULL, &maxLoc);
-        rectangle(img_result_3, maxLoc, Point(maxLoc.x + img_template.cols, maxLoc.y + img_template.rows), Scalar(0, 255, 0), 1);
+        rectangle(img_result_3, peaks[i], Point(peaks[i].x + img_template.cols, peaks[i].y + img_template.rows), Scalar(0, 255, 0), 1);
+        detections.write(Detection(0, CLASS_MATCH, Rect(peaks[i], img_template.size()), peak_values[i] / 255));
     }
     imshow("Resultaat: alle matches", img_result_3);
 
@@ -145,7 +128,7 @@ int main(int argc, char * argv[])
     for(int i = 0; i < steps; i++)
     {
     	Mat rotated = img_input.clone();
-    	rotate(img_input, (i+1)*step_angle, rotated);
+    	rotateImage(img_input, (i+1)*step_angle, rotated);
     	rotated_images.push_back(rotated);
     }
 
@@ -154,23 +137,15 @@ int main(int argc, char * argv[])
     for(int i = 0; i < (int)rotated_images.size(); i++)
     {
     	Mat img_match(result_rows, result_cols, img_input.type());
-        Mat img_mask(img_input.rows, img_input.cols, CV_8U);
-        Mat img_labels;
-        double maxVal = 0.0;
 
     	matchTemplate(rotated_images[i], img_template, img_match, TM_CCORR_NORMED);
     	normalize(img_match, img_match, 255, 0, NORM_MINMAX, CV_8U);
-    	threshold(img_match, img_mask, 254, 255, THRESH_BINARY);
-    	int num_components = connectedComponents(img_mask, img_labels, 8);
+    	findPeaks(img_match, 254, peaks, &peak_values);
     	cerr << "Processing image " + to_string(i) << endl;
-    	for(int j = 1; j < num_components; j++)
+    	for(size_t j = 0; j < peaks.size(); j++)
     	{
-    		cerr << "   Processing cc " + to_string(j) << endl;
-    		Mat img_mask_component;
-    		Mat img_search;
-    		inRange(img_labels, j, j, img_mask_component);
-    		img_search = img_match & img_mask_component;
-    		minMaxLoc(img_search, NULL, &maxVal, NULL, &maxLoc);
+    		maxLoc = peaks[j];
+    		float maxVal = peak_values[j];
     		cerr << "       maxVal " << to_string(maxVal) << " at " << maxLoc << endl;
     		rectangle(rotated_images[i], maxLoc, Point(maxLoc.x + img_template.cols, maxLoc.y + img_template.rows), Scalar(0, 255, 0), 1);
 
@@ -185,12 +160,14 @@ int main(int argc, char * argv[])
     		line(img_result_4, pts[0], pts[1], Scalar(255, 0, 0));
     		line(img_result_4, pts[1], pts[2], Scalar(255, 0, 0));
     		line(img_result_4, pts[2], pts[3], Scalar(255, 0, 0));
-    		line(img_result_4, pts[4], pts[0], Scalar(255, 0, 0));
+    		line(img_result_4, pts[3], pts[0], Scalar(255, 0, 0));
+    		detections.write(Detection(0, CLASS_MATCH_ROTATED, boundingRect(pts), maxVal / 255, -1, pts.data(), (int)pts.size()));
     	}
     	//imwrite(to_string(i) + "rotated_match.jpg", rotated_images[i]);
     }
 
     imshow("result4", img_result_4);
+    detections.close();
 
     waitKey(0);
     return 0;
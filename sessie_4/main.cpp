@@ -1,6 +1,9 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <unistd.h>
+#include "common/detection_writer.hpp"
+#include "common/image_io.hpp"
+#include "common/robust_homography.hpp"
 
 using namespace std;
 using namespace cv;
@@ -8,7 +11,77 @@ using namespace cv::detail;
 
 const String keys("{help h usage ? | | print this message }"
                   "{@input         |<none>| input file}"
-                  "{@template      |<none>| template file}");
+                  "{@template      |<none>| template file}"
+                  "{filter         |pct   | match filter: min (3*min_dist), pct (distance percentile) or topk}"
+                  "{pct            |25    | percentile (0-100) of the match distances to keep for filter=pct}"
+                  "{k              |50    | number of best matches to keep for filter=topk}"
+                  "{homography     |prosac| homography estimator: prosac (matches sampled best first) or ransac (OpenCV)}"
+                  "{detections     |      | write the detected object as JSON line (.json) or binary record (.bin)}");
+
+/**
+ * Bepaal de afstand waaronder pct procent van de matches vallen.
+ * In plaats van de matches te sorteren wordt een histogram van de afstanden opgebouwd (1 pass), waarna
+ * de cumulatieve som doorlopen wordt tot het gevraagde percentiel bereikt is.
+ * @param matches   Matches waarvan de afstanden gebruikt worden
+ * @param min_dist  Kleinste afstand in matches
+ * @param max_dist  Grootste afstand in matches
+ * @param pct       Percentiel tussen 0 en 100
+ * @return          Bovengrens van de histogram bin waarin het percentiel valt
+ */
+static float distancePercentile(const vector<DMatch>& matches, double min_dist, double max_dist, double pct)
+{
+    const int num_bins = 256;
+    int hist[num_bins] = {0};
+
+    if(matches.empty() || max_dist <= min_dist)
+        return (float)max_dist;
+
+    double bin_width = (max_dist - min_dist) / num_bins;
+    for(const DMatch& m : matches)
+    {
+        int bin = (int)((m.distance - min_dist) / bin_width);
+        hist[min(bin, num_bins - 1)]++;
+    }
+
+    size_t target = (size_t)ceil(matches.size() * min(max(pct, 0.0), 100.0) / 100.0);
+    size_t cumulative = 0;
+    for(int bin = 0; bin < num_bins; bin++)
+    {
+        cumulative += hist[bin];
+        if(cumulative >= target)
+            return (float)(min_dist + (bin + 1) * bin_width);
+    }
+    return (float)max_dist;
+}
+
+/**
+ * Hou enkel de matches over met afstand <= dist_threshold.
+ * De goede matches worden in 1 pass naar voor geschoven (stream compaction), zonder erase() in de loop.
+ * @param matches         Matches, na afloop bevat deze vector enkel nog de goede matches
+ * @param dist_threshold  Maximale afstand van een goede match
+ */
+static void filterMatchesByDistance(vector<DMatch>& matches, float dist_threshold)
+{
+    matches.erase(remove_if(matches.begin(), matches.end(),
+                            [dist_threshold](const DMatch& m) { return m.distance > dist_threshold; }),
+                  matches.end());
+}
+
+/**
+ * Hou enkel de k matches met de kleinste afstand over.
+ * nth_element plaatst de k beste matches vooraan in O(n), enkel die k worden daarna gesorteerd.
+ * @param matches  Matches, na afloop bevat deze vector de k beste matches (gesorteerd op afstand)
+ * @param k        Aantal matches om over te houden
+ */
+static void selectTopKMatches(vector<DMatch>& matches, size_t k)
+{
+    if(k < matches.size())
+    {
+        nth_element(matches.begin(), matches.begin() + k, matches.end());
+        matches.resize(k);
+    }
+    sort(matches.begin(), matches.end());
+}
 
 int main(int argc, char * argv[])
 {
@@ -24,18 +97,7 @@ int main(int argc, char * argv[])
         return 1;
     }
 
-    img_input_scene = imread(path_input);
-    if(img_input_scene.empty())
-    {
-        cerr <<  "Could not open or find the input image with path '" + path_input + "'" << std::endl ;
-        return -1;
-    }
-    img_input_template = imread(path_template);
-    if(img_input_template.empty())
-    {
-        cerr <<  "Could not open or find the template image with path '" + path_input + "'" << std::endl ;
-        return -1;
-    }
+    openImgFiles({path_input, path_template}, {&img_input_scene, &img_input_template});
 
     //imshow("input", img_input_scene);
     //imshow("template", img_input_template);
@@ -121,21 +183,24 @@ int main(int argc, char * argv[])
 
 	fprintf(stderr, "Min distance: %f\n", min_dist);
 	fprintf(stderr, "Max distance: %f\n", max_dist);
-	/// enkel goede matches selecteren (dist <= threshold)
-	vector<DMatch> good_matches;
-	float dist_threshold = 3*min_dist;
-	fprintf(stderr, "Started with %d matches\n", matches.size());
-	for(int i = 0; i < matches.size(); i++)
+	/// enkel goede matches selecteren
+	vector<DMatch> good_matches = matches;
+	String filter = parser.get<String>("filter");
+	fprintf(stderr, "Started with %zu matches\n", matches.size());
+	if(filter == "topk")
 	{
-		if(matches[i].distance <= dist_threshold)
-		{
-			good_matches.push_back(matches[i]);
-			// verwijder deze match ook uit de matches vector voor de volgende iteratie van de do-while loop
-			matches.erase(matches.begin() + i);
-			i++;
-		}
+		selectTopKMatches(good_matches, (size_t)max(parser.get<int>("k"), 0));
 	}
-	fprintf(stderr, "%d matches remaining\n", matches.size());
+	else
+	{
+		/// threshold ofwel adaptief (percentiel van de afstanden), ofwel 3*min_dist
+		float dist_threshold = 3*min_dist;
+		if(filter == "pct")
+			dist_threshold = distancePercentile(matches, min_dist, max_dist, parser.get<double>("pct"));
+		fprintf(stderr, "Distance threshold: %f\n", dist_threshold);
+		filterMatchesByDistance(good_matches, dist_threshold);
+	}
+	fprintf(stderr, "%zu good matches remaining\n", good_matches.size());
 
 	/// matches tekenen
 	drawMatches( img_input_template, keypoints_orb_template, img_input_scene, keypoints_orb_scene,
@@ -148,6 +213,8 @@ int main(int argc, char * argv[])
 
 
 	/** Object detectie mbv RANSAC/homografie **/
+	/// PROSAC neemt de samples eerst uit de beste matches: sorteren op afstand (beste eerst)
+	sort(good_matches.begin(), good_matches.end());
 	std::vector<Point2f> tpl;
 	std::vector<Point2f> scene;
 	/// keypoint coordinaten van de good_matches ophalen
@@ -156,7 +223,27 @@ int main(int argc, char * argv[])
 		tpl.push_back( keypoints_orb_template[ good_matches[i].queryIdx ].pt );
 		scene.push_back( keypoints_orb_scene[ good_matches[i].trainIdx ].pt );
 	}
-	Mat H = findHomography( tpl, scene, RANSAC );
+	Mat inlier_mask;
+	Mat H;
+	if(parser.get<String>("homography") == "ransac")
+	{
+		H = findHomography( tpl, scene, RANSAC, 3, inlier_mask );
+	}
+	else
+	{
+		HomographyStats homography_stats;
+		H = findHomographyProsac( tpl, scene, 3, inlier_mask, &homography_stats );
+		fprintf(stderr, "PROSAC: %d iterations (%d degenerate samples), %d inliers, %.2f ms\n",
+		        homography_stats.iterations, homography_stats.degenerate, homography_stats.inliers,
+		        homography_stats.milliseconds);
+	}
+	if(H.empty())
+	{
+		cerr << "No homography found" << endl;
+		imshow( "Object detection", img_matches );
+		waitKey(0);
+		return 0;
+	}
 	/// Coordinaten van hoekpunten template
 	std::vector<Point2f> tpl_corners(4);
 	tpl_corners[0] = cvPoint(0,0);
@@ -172,6 +259,20 @@ int main(int argc, char * argv[])
 	line( img_matches, scene_corners[2] + Point2f( img_input_template.cols, 0), scene_corners[3] + Point2f( img_input_template.cols, 0), Scalar( 0, 255, 0), 4 );
 	line( img_matches, scene_corners[3] + Point2f( img_input_template.cols, 0), scene_corners[0] + Point2f( img_input_template.cols, 0), Scalar( 0, 255, 0), 4 );
 
+	/// gedetecteerd object wegschrijven: getransformeerde hoekpunten als polygoon, aantal inliers als score
+	String path_detections = parser.get<String>("detections");
+	if(!path_detections.empty())
+	{
+		DetectionWriter detections;
+		if(!detections.open(path_detections, {"object"}))
+		{
+			cerr << "Could not create output file '" + path_detections + "'" << endl;
+			return -1;
+		}
+		detections.write(Detection(0, 0, boundingRect(scene_corners), (float)countNonZero(inlier_mask), -1,
+		                           scene_corners.data(), (int)scene_corners.size()));
+	}
+
 
 
 
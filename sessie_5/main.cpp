@@ -1,5 +1,9 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "common/image_io.hpp"
+#include "common/mat_cache.hpp"
+#include "common/pixel_classifiers.hpp"
+#include "common/superpixels.hpp"
 
 using namespace std;
 using namespace cv;
@@ -8,7 +12,10 @@ using namespace cv::ml;
 
 const String keys("{help h usage ? | | print this message }"
                   "{@train         |<none>| training file}"
-                  "{@test          |<none>| test file}");
+                  "{@test          |<none>| test file}"
+                  "{cache          |      | directory for the memory-mapped cache of decoded and HSV images}"
+                  "{superpixels    |0     | classify superpixels of about this size (pixels) instead of single pixels (0 = per pixel)}"
+                  "{reject_green   |true  | skip green pixels (hue 30-90) in the classification, they are background}");
 
 Mat img_train;
 bool fg = true;
@@ -54,6 +61,8 @@ int main(int argc, char * argv[])
 
     String path_train = parser.get<String>("@train");
     String path_test = parser.get<String>("@test");
+    int superpixel_size = parser.get<int>("superpixels");
+    bool reject_green = parser.get<bool>("reject_green");
 
     if(path_train.empty() or path_test.empty())
     {
@@ -61,21 +70,18 @@ int main(int argc, char * argv[])
         return 1;
     }
 
-    img_train = imread(path_train);
-    if(img_train.empty())
-    {
-        cerr <<  "Could not open or find the input image with path '" + path_train + "'" << std::endl ;
-        return -1;
-    }
-    img_test = imread(path_test);
-    if(img_test.empty())
+    /// met --cache worden de ingelezen, uitgesmeerde en HSV afbeeldingen bij een volgende run rechtstreeks gemapt
+    MatCache cache(parser.get<String>("cache"));
+    String key_train = cache.fileKey(path_train) + "/blur5", key_test = cache.fileKey(path_test) + "/blur5";
+    /* Gaussian blur toevoegen om te vermijden dat je niet op groene pitten kan klikken */
+    if(!cache.load(key_train, img_train) || !cache.load(key_test, img_test))
     {
-        cerr <<  "Could not open or find the template image with path '" + path_train + "'" << std::endl ;
-        return -1;
+        openImgFiles({path_train, path_test}, {&img_train, &img_test});
+        GaussianBlur(img_test, img_test, Size(5, 5), 0);
+        GaussianBlur(img_train, img_train, Size(5, 5), 0);
+        cache.store(key_train, img_train);
+        cache.store(key_test, img_test);
     }
-    /* Gaussian blur toevoegen om te vermijden dat je niet op groene pitten kan klikken */
-    GaussianBlur(img_test, img_test, Size(5, 5), 0);
-    GaussianBlur(img_train, img_train, Size(5, 5), 0);
 
     /** Training **/
     /// Voorgrond pixels kiezen
@@ -89,121 +95,62 @@ int main(int argc, char * argv[])
 
     /** Trainingsdata maken: als descriptors van een pixel nemen we de HSV waarde van de pixel **/
     Mat img_train_hsv;
-    cvtColor(img_train, img_train_hsv, COLOR_BGR2HSV);
+    cache.getOrCompute(key_train + "/hsv", img_train_hsv, [&](Mat &m) { cvtColor(img_train, m, COLOR_BGR2HSV); });
+
+    /// foreground pixels worden als 1 geclassificeerd, background pixels als 0
+    Mat desc_fg = hsvSamples(img_train_hsv, pts_fg);
+    Mat desc_bg = hsvSamples(img_train_hsv, pts_bg);
+    cout << "Training data: " << desc_fg.rows << " foreground, " << desc_bg.rows << " background samples" << endl;
 
-    Mat desc_fg(pts_fg.size(), 3, CV_32FC1);
-    /// foreground pixels worden als 1 geclassificeerd
-    Mat labels_fg = Mat::ones(pts_fg.size(), 1, CV_32SC1);
-    for(int i = 0; i < pts_fg.size(); i++)
+    /** Classifiers maken en trainen: KNN (k = 3), Normal Bayes en lineaire SVM **/
+    PixelClassifiers classifiers = trainPixelClassifiers(desc_fg, desc_bg, 3);
+
+    /** Classifiers toepasssen op input afbeelding
+     *  Alle pixels worden in 1 predict() oproep per classifier geclassificeerd, het resultaat is een masker **/
+    Mat img_test_hsv;
+    cache.getOrCompute(key_test + "/hsv", img_test_hsv, [&](Mat &m) { cvtColor(img_test, m, COLOR_BGR2HSV); });
+    Mat mask_knn, mask_bayes, mask_svm;
+    /* extra opdracht: groene pixels eruit filteren
+     * Hue tussen 30 en 90 (= van 60 graden tot 180 in Hue cirkel) komen overeen met groen. In plaats van de resultaten
+     * achteraf terug naar HSV om te zetten, worden de groene pixels op voorhand uitgesloten: ze zijn achtergrond
+     * zonder dat de classifier ze ziet, en elke classifier geeft meteen het gecombineerde masker */
+    Mat reject;
+    if(superpixel_size > 0)
     {
-        Vec3b hsv = img_train_hsv.at<Vec3b>(pts_fg[i].y, pts_fg[i].x);
-        desc_fg.at<float>(i, 0) = hsv[0];
-        desc_fg.at<float>(i, 1) = hsv[1];
-        desc_fg.at<float>(i, 2) = hsv[2];
+        /// de vruchten zijn grote, egale gebieden: superpixels (SLIC op de Lab afbeelding) classificeren in plaats
+        /// van pixels, met als descriptor de gemiddelde HSV waarde van de superpixel
+        Mat img_test_lab, labels;
+        cvtColor(img_test, img_test_lab, COLOR_BGR2Lab);
+        int num_superpixels = slicSuperpixels(img_test_lab, superpixel_size, 20.0f, labels);
+        Mat desc_superpixels = superpixelHsvMeans(img_test_hsv, labels, num_superpixels);
+        cout << num_superpixels << " superpixels geclassificeerd in plaats van " << img_test.total() << " pixels" << endl;
+        if(reject_green)
+            reject = hueRejectMask(desc_superpixels, 30, 90);
+        classifyRegions(classifiers.knn, desc_superpixels, labels, mask_knn, reject);
+        classifyRegions(classifiers.bayes, desc_superpixels, labels, mask_bayes, reject);
+        classifyRegions(classifiers.svm, desc_superpixels, labels, mask_svm, reject);
     }
-    Mat desc_bg(pts_bg.size(), 3, CV_32FC1);
-    /// background pixels worden als 0 geclassifeerd
-    Mat labels_bg = Mat::zeros(pts_bg.size(), 1, CV_32SC1);
-    for(int i = 0; i < pts_bg.size(); i++)
+    else
     {
-        Vec3b hsv = img_train_hsv.at<Vec3b>(pts_bg[i].y, pts_bg[i].x);
-        desc_bg.at<float>(i, 0) = hsv[0];
-        desc_bg.at<float>(i, 1) = hsv[1];
-        desc_bg.at<float>(i, 2) = hsv[2];
+        if(reject_green)
+            reject = hueRejectMask(img_test_hsv, 30, 90);
+        classifyPixels(classifiers.knn, img_test_hsv, mask_knn, reject);
+        classifyPixels(classifiers.bayes, img_test_hsv, mask_bayes, reject);
+        classifyPixels(classifiers.svm, img_test_hsv, mask_svm, reject);
     }
-    /// trainData maken volgens formaat dat API verwacht
-    Mat trainingData, labels;
-    // hierboven gemaakte descriptor matrices (fg en bg) concateneren
-    vconcat(desc_fg, desc_bg, trainingData);
-    vconcat(labels_fg, labels_bg, labels);
-    Ptr<TrainData> trainData = TrainData::create(trainingData, ROW_SAMPLE, labels);
-    cout << "Training data: " << endl
-         << "getNSamples\t" << trainData->getNSamples() <<endl
-         << "getSamples\n"  << trainData->getSamples()  <<endl
-         << endl;
-
-    /** Classifiers maken en trainen **/
-    /// K-Nearest-Neighbours
-    Ptr<KNearest> knn = KNearest::create();
-    knn->setIsClassifier(true);
-    knn->setDefaultK(3);
-    knn->setAlgorithmType(KNearest::BRUTE_FORCE);
-    knn->train(trainData);
-
-
-    /// Normal Bayes
-    Ptr<NormalBayesClassifier> bayes = NormalBayesClassifier::create();
-    bayes->train(trainData);
-    /// SVM
-    Ptr<SVM> svm = SVM::create();
-    svm->setType(SVM::C_SVC);
-    svm->setKernel(SVM::LINEAR);
-    svm->setTermCriteria(TermCriteria(TermCriteria::MAX_ITER, 100, 1e-6));
-    svm->train(trainData);
-
-    /** Classifiers toepasssen op input afbeelding **/
-    Mat img_test_hsv;
-    cvtColor(img_test, img_test_hsv, COLOR_BGR2HSV);
-    Mat desc_test(1, 3, CV_32FC1);
-    Mat results_knn, results_bayes;
-    Mat outputProbs;
-    Mat img_result_knn(img_test.rows, img_test.cols, CV_8UC3);
-    Mat img_result_bayes(img_test.rows, img_test.cols, CV_8UC3);
-    Mat img_result_svm(img_test.rows, img_test.cols, CV_8UC3);
-    for(int i = 0; i < img_test.rows; i++)
-    {
-        for(int j = 0; j < img_test.cols; j++)
-        {
-            Vec3b hsv = img_test_hsv.at<Vec3b>(i, j);
-            desc_test.at<float>(0, 0) = hsv[0];
-            desc_test.at<float>(0, 1) = hsv[1];
-            desc_test.at<float>(0, 2) = hsv[2];
-            /// KNN toepassen
-            knn->findNearest(desc_test, knn->getDefaultK(), results_knn);
-            if(results_knn.at<float>(0, 0) == 1)
-                img_result_knn.at<Vec3b>(i, j) = img_test.at<Vec3b>(i, j);
-            else
-                img_result_knn.at<Vec3b>(i, j) = Vec3b(0, 0, 0);
-            /// Bayes toepassen
-
-            if((int)bayes->predict(desc_test) == 1)
-            {
-            	img_result_bayes.at<Vec3b>(i, j) = img_test.at<Vec3b>(i, j);
-            }
-            /// SVM toepassen
-            //cerr << svm->predict(desc_test) << endl;
-            if((int)svm->predict(desc_test) == 1)
-                img_result_svm.at<Vec3b>(i, j) = img_test.at<Vec3b>(i, j);
-            else
-                img_result_svm.at<Vec3b>(i, j) = Vec3b(0, 0, 0);
-
-        }
-    }
-
-    imshow("Resultaat KNN", img_result_knn);
-    imshow("Resultaat Bayes", img_result_bayes);
-    imshow("Resultaat SVM", img_result_svm);
-
-    /* extra opdracht: groene pixels eruit filteren */
-
-    Mat tmp, mask;
-
-    cvtColor(img_result_knn, tmp, COLOR_BGR2HSV);
-    // Hue tussen 30 en 90 (= van 60 graden tot 180 in Hue cirkel) komen overeen met groen
-    inRange(tmp, Scalar(30, 0, 0), Scalar(90, 255, 255), mask);
-    img_result_knn.setTo(Scalar(0,0,0), mask);
-    cvtColor(img_result_bayes, tmp, COLOR_BGR2HSV);
-	inRange(tmp, Scalar(30, 0, 0), Scalar(90, 255, 255), mask);
-	img_result_bayes.setTo(Scalar(0,0,0), mask);
-	cvtColor(img_result_svm, tmp, COLOR_BGR2HSV);
-	inRange(tmp, Scalar(30, 0, 0), Scalar(90, 255, 255), mask);
-	img_result_svm.setTo(Scalar(0,0,0), mask);
-
-
-    imshow("Resultaat KNN (met extra kleursgementatie)", img_result_knn);
-    imshow("Resultaat Bayes (met extra kleursgementatie)", img_result_bayes);
-    imshow("Resultaat SVM (met extra kleursgementatie)", img_result_svm);
-
+    if(reject_green)
+        cout << countNonZero(reject) << " van de " << reject.total() << " groen en niet geclassificeerd" << endl;
+    Mat img_result_knn = Mat::zeros(img_test.size(), CV_8UC3);
+    Mat img_result_bayes = Mat::zeros(img_test.size(), CV_8UC3);
+    Mat img_result_svm = Mat::zeros(img_test.size(), CV_8UC3);
+    img_test.copyTo(img_result_knn, mask_knn);
+    img_test.copyTo(img_result_bayes, mask_bayes);
+    img_test.copyTo(img_result_svm, mask_svm);
+
+    String suffix = reject_green ? " (met extra kleursgementatie)" : "";
+    imshow("Resultaat KNN" + suffix, img_result_knn);
+    imshow("Resultaat Bayes" + suffix, img_result_bayes);
+    imshow("Resultaat SVM" + suffix, img_result_svm);
 
     waitKey(0);
     return 0;
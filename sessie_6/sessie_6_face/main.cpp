@@ -1,31 +1,363 @@
 #include <iostream>
+#include <atomic>
+#include <thread>
 #include <opencv2/opencv.hpp>
+#include "common/bounded_queue.hpp"
+#include "common/detection_writer.hpp"
+#include "common/frame_sink.hpp"
+#include "common/image_pyramid.hpp"
+#include "common/motion_gate.hpp"
+#include "common/nms.hpp"
+#include "common/stage_stats.hpp"
 
 using namespace std;
 using namespace cv;
 
+/**
+ * Gezichtsdetectie met HAAR en LBP cascades.
+ * Het programma is opgebouwd als pipeline met 3 stages, verbonden door begrensde queues:
+ *   - decoder thread: leest frames in een buffer uit de frame pool
+ *   - detector workers: voeren per frame een HAAR en een LBP taak uit, beide cascades lopen dus gelijktijdig
+ *   - renderer (main thread): tekent de detecties in volgorde van de frames en toont/schrijft het resultaat
+ * Verwerkte frame buffers gaan terug naar de pool, zodat er na het opstarten geen frames meer gealloceerd worden.
+ * Beide cascades delen per frame 1 grijswaarden pyramide (ImagePyramid), waarvan de niveaus pas berekend worden
+ * wanneer een cascade ze nodig heeft.
+ *
+ * Met --track=N wordt enkel elk N-de frame volledig gescand (detect-then-track). Op de frames daartussen volgt de
+ * renderer de gezichten door de cascades enkel te laten zoeken in een ROI rond hun vorige positie. Verliest de
+ * tracker een gezicht, dan stuurt de renderer dat frame terug naar de workers voor een volledige scan, en wacht het
+ * met tekenen tot die klaar is. Intussen lopen de workers verder met de volgende frames.
+ *
+ * Met --motion=P vergelijkt de decoder elk frame eerst met een achtergrondmodel (MotionGate). Frames waarin minder
+ * dan P procent van de pixels veranderd is, worden niet gescand en krijgen de detecties van het vorige frame.
+ * Op de andere frames scannen de cascades enkel het gebied rond de veranderde pixels.
+ *
+ * Met --nms=IOU worden de HAAR en LBP detecties samengevoegd met non-maximum suppression: overlappende detecties
+ * van beide cascades worden 1 gezicht, met als positie het gewogen gemiddelde volgens hun score.
+ *
+ * Met --cascade wordt in 2 stappen gedetecteerd: de snelle LBP cascade zoekt kandidaten in het volledige frame, de
+ * tragere HAAR cascade controleert enkel een vergrote ROI rond elke kandidaat, voor gezichten van ongeveer dezelfde
+ * grootte. Enkel kandidaten die HAAR bevestigt blijven over. De score van een gezicht is de som van het aantal
+ * detecties van beide cascades, zo telt een gezicht dat beide cascades sterk vinden het zwaarst.
+ *
+ * Per stage wordt de latency bijgehouden (StageStats): elke --stats seconden en op het einde van de video worden
+ * p50/p95/p99, frames per seconde en het aantal weggegooide en lege frames getoond, en met --stats_csv ook
+ * achteraan toegevoegd aan een CSV bestand.
+ *
+ * Gebruik zonder display (bv. om frames per seconde te meten op faces.mp4):
+ *   sessie_6_face faces.mp4 haarcascade_frontalface_alt.xml lbpcascade_frontalface_improved.xml --headless --output=faces.json
+ */
 
 const String keys("{help h usage ? |<none>| print this message }"
                   "{@video         |<none>| video test file}"
                   "{@xml_haar      |<none>| classifier file for HAAR}"
-                  "{@xml_lbp       |<none>| classifier file for LBP}");
+                  "{@xml_lbp       |<none>| classifier file for LBP}"
+                  "{headless       |      | do not display the result}"
+                  "{output o       |      | write annotated video (.avi, .mp4) or detections as JSON lines (.json, .jsonl) or binary records (.bin) to this file}"
+                  "{skip           |      | drop frames when the video writer cannot keep up}"
+                  "{workers        |0     | number of detector threads (0 = number of CPU cores)}"
+                  "{pool           |8     | number of frame buffers in flight}"
+                  "{track          |0     | detect-then-track: full detection every N frames, ROI tracking in between (0 = off)}"
+                  "{scale          |1.1   | scale factor between pyramid levels}"
+                  "{min_size       |0     | smallest face size in pixels (0 = cascade window size)}"
+                  "{max_size       |0     | largest face size in pixels (0 = no limit)}"
+                  "{roi            |      | mask image (white = detect) restricting detection to a part of the frame}"
+                  "{motion         |0     | motion gate: minimum percentage of changed pixels to run the detectors (0 = off)}"
+                  "{cascade        |      | two-stage detection: LBP proposes faces in the whole frame, HAAR only verifies them}"
+                  "{nms            |0     | merge the HAAR and LBP detections with non-maximum suppression at this IoU (0 = off, e.g. 0.3)}"
+                  "{stats          |5     | print latency statistics every N seconds (0 = only at the end)}"
+                  "{stats_csv      |      | append the latency statistics to this CSV file}");
 
+/** Een frame dat door de pipeline loopt, de buffers worden hergebruikt via de frame pool */
+struct FrameSlot
+{
+    long index;
+    /// true als de volledige frame gescand wordt, false als de gezichten gevolgd worden vanuit het vorige frame
+    bool keyframe;
+    /// true als er niets bewogen heeft en de detecties van het vorige frame hergebruikt worden
+    bool reuse;
+    /// deel van het frame dat de cascades scannen, met de bijhorende detector instellingen
+    Rect region;
+    DetectorConfig config;
+    Mat frame, frame_output;
+    /// grijswaarden pyramide van frame, gedeeld door beide cascades
+    ImagePyramid pyramid;
+    vector<Rect> faces_haar, faces_lbp;
+    vector<int> num_detections_haar, num_detections_lbp;
+    /// HAAR en LBP detecties samengevoegd met NMS (--nms)
+    vector<Rect> faces;
+    vector<int> num_detections;
+    /// aantal detector taken dat nog moet lopen op dit frame
+    atomic<int> pending;
+    /// tijdstip waarop het decoderen van dit frame begon, voor de latency van de hele pipeline
+    StageStats::Clock::time_point t_decode;
+};
+
+enum DetectorType { DETECTOR_HAAR, DETECTOR_LBP };
+
+enum Stage { STAGE_DECODE, STAGE_HAAR, STAGE_LBP, STAGE_TRACK, STAGE_RENDER, STAGE_PIPELINE };
+
+struct DetectTask
+{
+    int slot;
+    DetectorType detector;
+};
+
+/**
+ * Detect-then-track voor gezichten.
+ * Tussen 2 volledige detecties wordt elk gezicht enkel gezocht in een vergrote ROI rond zijn vorige positie,
+ * met een beperkte range van objectgroottes. Zolang gezichten traag bewegen is dit veel goedkoper dan een
+ * volledige scan. Net als een volledige scan zoekt de tracker in de pyramide van het frame en enkel binnen de ROI
+ * van de gebruiker. Wanneer een gezicht niet teruggevonden wordt, of zijn score sterk daalt, vraagt de tracker
+ * een nieuwe volledige detectie.
+ */
+class FaceTracker
+{
+public:
+    FaceTracker(CascadeClassifier &haar, CascadeClassifier &lbp, double roi_scale = 1.5, double size_range = 1.25)
+        : roi_scale(roi_scale), size_range(size_range)
+    {
+        cascades[DETECTOR_HAAR] = &haar;
+        cascades[DETECTOR_LBP] = &lbp;
+    }
+
+    /**
+     * Start opnieuw vanaf de detecties van een volledige scan.
+     * @param slot  Frame met de resultaten van een volledige detectie
+     */
+    void reset(const FrameSlot &slot)
+    {
+        faces[DETECTOR_HAAR] = slot.faces_haar;
+        faces[DETECTOR_LBP] = slot.faces_lbp;
+        ref_scores[DETECTOR_HAAR] = slot.num_detections_haar;
+        ref_scores[DETECTOR_LBP] = slot.num_detections_lbp;
+    }
+
+    /**
+     * Zoek de gevolgde gezichten terug in een nieuw frame, de resultaten worden in slot geschreven.
+     * @param slot    Frame waarin gezocht wordt, met zijn pyramide
+     * @param config  Detector instellingen van een volledige scan, de ROI wordt per gezicht verkleind
+     * @return        false als de betrouwbaarheid gedaald is en een volledige detectie nodig is
+     */
+    bool update(FrameSlot &slot, const DetectorConfig &config)
+    {
+        vector<Rect> *out_faces[] = {&slot.faces_haar, &slot.faces_lbp};
+        vector<int> *out_scores[] = {&slot.num_detections_haar, &slot.num_detections_lbp};
+        bool confident = true;
+
+        for(int d = 0; d < 2; d++)
+        {
+            detectCascadeInRegions(*cascades[d], slot.pyramid, config, faces[d], *out_faces[d], *out_scores[d],
+                                   &confirmed, roi_scale, size_range);
+            if(confirmed.size() < faces[d].size())
+                confident = false;
+            /// verloren gezichten blijven gevolgd vanaf hun laatste positie
+            for(size_t k = 0; k < confirmed.size(); k++)
+            {
+                int i = confirmed[k];
+                faces[d][i] = (*out_faces[d])[k];
+                if((*out_scores[d])[k] * 2 < ref_scores[d][i])
+                    confident = false;
+            }
+        }
+        return confident;
+    }
+
+private:
+    CascadeClassifier *cascades[2];
+    vector<Rect> faces[2];
+    vector<int> ref_scores[2];
+    vector<int> confirmed;
+    double roi_scale, size_range;
+};
+
+/**
+ * Voeg de HAAR en LBP detecties van 1 frame samen met non-maximum suppression.
+ * Elk samengevoegd gezicht krijgt de score van zijn beste detectie.
+ * @param slot  Frame met detecties, het resultaat komt in faces en num_detections
+ * @param iou   Detecties die meer dan dit overlappen zijn hetzelfde gezicht
+ */
+static void mergeFaces(FrameSlot &slot, float iou)
+{
+    vector<Rect> boxes(slot.faces_haar);
+    boxes.insert(boxes.end(), slot.faces_lbp.begin(), slot.faces_lbp.end());
+    vector<float> scores(slot.num_detections_haar.begin(), slot.num_detections_haar.end());
+    scores.insert(scores.end(), slot.num_detections_lbp.begin(), slot.num_detections_lbp.end());
+    vector<int> keep;
+    nonMaximumSuppression(boxes, scores, iou, keep, &slot.faces);
+    slot.num_detections.clear();
+    for(int i : keep)
+        slot.num_detections.push_back((int)scores[i]);
+}
+
+/**
+ * Combineer de HAAR en LBP detecties van de 2-staps detectie (--cascade).
+ * Elk HAAR gezicht krijgt als score de som van zijn aantal detecties en dat van de LBP kandidaat die het meest
+ * overlapt. Overlappende gezichten worden samengevoegd met NMS.
+ * @param slot  Frame met detecties, het resultaat komt in faces en num_detections
+ * @param iou   Gezichten die meer dan dit overlappen zijn hetzelfde gezicht
+ */
+static void fuseFaces(FrameSlot &slot, float iou)
+{
+    vector<float> scores;
+    for(size_t i = 0; i < slot.faces_haar.size(); i++)
+    {
+        float best_iou = 0;
+        int lbp_score = 0;
+        for(size_t j = 0; j < slot.faces_lbp.size(); j++)
+        {
+            float overlap = intersectionOverUnion(slot.faces_haar[i], slot.faces_lbp[j]);
+            if(overlap > best_iou)
+            {
+                best_iou = overlap;
+                lbp_score = slot.num_detections_lbp[j];
+            }
+        }
+        scores.push_back((float)(slot.num_detections_haar[i] + lbp_score));
+    }
+    vector<int> keep;
+    nonMaximumSuppression(slot.faces_haar, scores, iou, keep, &slot.faces);
+    slot.num_detections.clear();
+    for(int i : keep)
+        slot.num_detections.push_back((int)scores[i]);
+}
+
+/**
+ * Teken de HAAR (groene rechthoek) en LBP (blauwe cirkel) detecties met hun score,
+ * of de samengevoegde detecties (gele rechthoek).
+ * @param frame_output  Afbeelding waarop getekend wordt
+ * @param slot          Frame met detecties
+ * @param merged        true om de samengevoegde detecties te tekenen, zie mergeFaces()
+ */
+static void drawFaces(Mat &frame_output, const FrameSlot &slot, bool merged)
+{
+    char score[16];
+    if(merged)
+    {
+        for(size_t i = 0; i < slot.faces.size(); i++)
+        {
+            sprintf(score, "%d", slot.num_detections[i]);
+            rectangle(frame_output, slot.faces[i], Scalar(0, 255, 255), 3);
+            putText(frame_output, score, Point(slot.faces[i].x + slot.faces[i].width, slot.faces[i].y),
+                    FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 255, 255), 1);
+        }
+        return;
+    }
+    for(size_t i = 0; i < slot.faces_haar.size(); i++)
+    {
+        const Rect &face = slot.faces_haar[i];
+        sprintf(score, "%d", slot.num_detections_haar[i]);
+        Point tp(face.x + face.width, face.y);
+        rectangle(frame_output, face, Scalar(0, 255, 0), 3);
+        putText(frame_output, score, tp, FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 255, 0), 1);
+    }
+
+    for(size_t i = 0; i < slot.faces_lbp.size(); i++)
+    {
+        const Rect &face = slot.faces_lbp[i];
+        sprintf(score, "%d", slot.num_detections_lbp[i]);
+        Point tp(face.x + face.width, face.y + face.height);
+        Point cp(face.x + face.width / 2, face.y + face.height / 2);
+        circle(frame_output, cp, max(face.width / 2, face.height / 2), Scalar(255, 0, 0), 3);
+        putText(frame_output, score, tp, FONT_HERSHEY_SIMPLEX, 1.0, Scalar(255, 0, 0), 1);
+    }
+}
+
+/**
+ * Schrijf de detecties van 1 frame als detectie records, de samengevoegde detecties als klasse 2.
+ */
+static void writeFaces(DetectionWriter &out, const FrameSlot &slot, bool merged)
+{
+    if(merged)
+    {
+        for(size_t i = 0; i < slot.faces.size(); i++)
+            out.write(Detection(slot.index, 2, slot.faces[i], (float)slot.num_detections[i]));
+        return;
+    }
+    const vector<Rect> *faces[] = {&slot.faces_haar, &slot.faces_lbp};
+    const vector<int> *scores[] = {&slot.num_detections_haar, &slot.num_detections_lbp};
+    for(int d = 0; d < 2; d++)
+    {
+        for(size_t i = 0; i < faces[d]->size(); i++)
+            out.write(Detection(slot.index, d, (*faces[d])[i], (float)(*scores[d])[i]));
+    }
+}
+
+/**
+ * Voer 1 detector taak uit op een frame, in het deel van het frame dat slot.config aangeeft.
+ * Bij 2-staps detectie (--cascade) controleert de LBP taak meteen zijn kandidaten met HAAR: enkel de kandidaten die
+ * HAAR bevestigt blijven over in faces_lbp, hun HAAR detecties komen in faces_haar.
+ * @param haar      HAAR cascade, niet gedeeld met andere threads
+ * @param lbp       LBP cascade, niet gedeeld met andere threads
+ * @param detector  Cascade die de taak uitvoert
+ * @param two_stage true voor 2-staps detectie, er is dan enkel een LBP taak
+ * @param slot      Frame waarop gedetecteerd wordt, de detecties worden erin geschreven
+ * @param stats     Ontvangt de latency van de HAAR en LBP stages
+ */
+static void detectFaces(CascadeClassifier &haar, CascadeClassifier &lbp, DetectorType detector, bool two_stage,
+                        FrameSlot &slot, StageStats &stats)
+{
+    StageStats::Clock::time_point t_detect = StageStats::Clock::now();
+    if(detector == DETECTOR_HAAR)
+        detectCascade(haar, slot.pyramid, slot.config, slot.faces_haar, slot.num_detections_haar);
+    else
+        detectCascade(lbp, slot.pyramid, slot.config, slot.faces_lbp, slot.num_detections_lbp);
+    stats.record(detector == DETECTOR_HAAR ? STAGE_HAAR : STAGE_LBP, t_detect);
+    if(!two_stage)
+        return;
+
+    /// HAAR enkel rond de LBP kandidaten, kandidaten die HAAR niet bevestigt vallen weg
+    StageStats::Clock::time_point t_verify = StageStats::Clock::now();
+    vector<int> confirmed;
+    detectCascadeInRegions(haar, slot.pyramid, slot.config, slot.faces_lbp, slot.faces_haar, slot.num_detections_haar,
+                           &confirmed);
+    for(size_t i = 0; i < confirmed.size(); i++)
+    {
+        slot.faces_lbp[i] = slot.faces_lbp[confirmed[i]];
+        slot.num_detections_lbp[i] = slot.num_detections_lbp[confirmed[i]];
+    }
+    slot.faces_lbp.resize(confirmed.size());
+    slot.num_detections_lbp.resize(confirmed.size());
+    stats.record(STAGE_HAAR, t_verify);
+}
+
+static bool endsWith(const String &str, const String &suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
 int main(int argc, char * argv[])
 {
     CommandLineParser parser(argc, argv, keys);
-    Mat img_test;
 
     String path_video = parser.get<String>("@video");
     String path_xml_haar = parser.get<String>("@xml_haar");
     String path_xml_lbp = parser.get<String>("@xml_lbp");
-
+    String path_output = parser.get<String>("output");
+    bool headless = parser.has("headless");
+    int num_workers = parser.get<int>("workers");
+    int pool_size = max(parser.get<int>("pool"), 1);
+    int track_interval = max(parser.get<int>("track"), 0);
+    double motion = parser.get<double>("motion");
+    float nms = parser.get<float>("nms");
+    bool two_stage = parser.has("cascade");
+    double stats_interval = parser.get<double>("stats");
+    String path_stats_csv = parser.get<String>("stats_csv");
+    DetectorConfig config;
+    config.scale_factor = parser.get<double>("scale");
+    int min_size = parser.get<int>("min_size"), max_size = parser.get<int>("max_size");
+    if(min_size > 0)
+        config.min_size = Size(min_size, min_size);
+    if(max_size > 0)
+        config.max_size = Size(max_size, max_size);
 
     if(path_video.empty() or path_xml_haar.empty() or path_xml_lbp.empty())
     {
         cerr << "Please provide all arguments" << endl;
         return 1;
     }
+    if(num_workers <= 0)
+        num_workers = max((int)thread::hardware_concurrency(), 1);
 
     VideoCapture cap(path_video);
     if(!cap.isOpened())
@@ -34,62 +366,284 @@ int main(int argc, char * argv[])
         return 1;
     }
 
+    /// CascadeClassifier is niet thread-safe, elke worker krijgt dus zijn eigen instanties
+    vector<CascadeClassifier> haar(num_workers), lbp(num_workers);
+    for(int w = 0; w < num_workers; w++)
+    {
+        if(!haar[w].load(path_xml_haar))
+        {
+            fprintf(stderr, "Cannot load haar model file %s\n", path_xml_haar.c_str());
+            return 1;
+        }
+        if(!lbp[w].load(path_xml_lbp))
+        {
+            fprintf(stderr, "Cannot load lbp model file %s\n", path_xml_lbp.c_str());
+            return 1;
+        }
+    }
 
-    CascadeClassifier haar(path_xml_haar);
-    CascadeClassifier lbp(path_xml_lbp);
-    if(haar.empty())
+    Size frame_size((int)cap.get(CAP_PROP_FRAME_WIDTH), (int)cap.get(CAP_PROP_FRAME_HEIGHT));
+    String path_roi = parser.get<String>("roi");
+    config.setRoiMask(loadRoiMask(path_roi, frame_size));
+    if(!path_roi.empty() && config.roi_mask.empty())
     {
-        fprintf(stderr, "Cannot load haar model file %s\n", path_xml_haar.c_str());
+        fprintf(stderr, "Cannot load roi mask %s\n", path_roi.c_str());
         return 1;
     }
 
-    if(lbp.empty())
+    /// de tracker draait in de renderer (main thread) en heeft dus ook zijn eigen cascades nodig
+    CascadeClassifier haar_track, lbp_track;
+    FaceTracker tracker(haar_track, lbp_track);
+    if(track_interval > 0)
     {
-        fprintf(stderr, "Cannot load lbp model file %s\n", path_xml_lbp.c_str());
-        return 1;
+        if(!haar_track.load(path_xml_haar))
+        {
+            fprintf(stderr, "Cannot load haar model file %s\n", path_xml_haar.c_str());
+            return 1;
+        }
+        if(!lbp_track.load(path_xml_lbp))
+        {
+            fprintf(stderr, "Cannot load lbp model file %s\n", path_xml_lbp.c_str());
+            return 1;
+        }
+    }
+
+    /// output: geannoteerde video (geschreven in een aparte thread) of detectie records
+    AsyncVideoSink writer;
+    DetectionWriter detections;
+    if(!path_output.empty())
+    {
+        if(endsWith(path_output, ".json") || endsWith(path_output, ".jsonl") || endsWith(path_output, ".bin"))
+            detections.open(path_output, {"face_haar", "face_lbp", "face"});
+        else
+            writer.open(path_output, VideoWriter::fourcc('M', 'J', 'P', 'G'), cap.get(CAP_PROP_FPS), frame_size, pool_size,
+                        parser.has("skip"));
+        if(!detections.isOpen() && !writer.isOpened())
+        {
+            fprintf(stderr, "Cannot open output file %s\n", path_output.c_str());
+            return 1;
+        }
+    }
+
+    StageStats stats({"decode", "haar", "lbp", "track", "render", "pipeline"});
+    FILE *stats_csv = nullptr;
+    if(!path_stats_csv.empty())
+    {
+        stats_csv = StageStats::openCsv(path_stats_csv);
+        if(!stats_csv)
+        {
+            fprintf(stderr, "Cannot open statistics file %s\n", path_stats_csv.c_str());
+            return 1;
+        }
     }
 
-    /** Scores berekenen met overloaded detectMultiScale */
-    /** Score naast bounding boxes met putText */
-    namedWindow("output");
-    Mat frame;
-    for(;;)
-    {
-        vector<Rect> faces_haar, faces_lbp;
-        cap >> frame;
-    	if(frame.empty())
-    	{
-    		cerr << "Bad or empty frame, skipping this frame..." << endl;
-    		continue;
-    	}
-        Mat frame_output = frame.clone();
-        vector<double> weights_haar, weights_lbp;
-        vector<int> num_detections_haar, num_detections_lbp;
-        haar.detectMultiScale(frame, faces_haar, num_detections_haar);
-        lbp.detectMultiScale(frame, faces_lbp, num_detections_lbp);
-        if(faces_haar.size() > 0 || faces_lbp.size() > 0)
+    /// De pipeline verdeelt het werk zelf over de cores, OpenCV's interne parallelisatie zou dit enkel verstoren
+    setNumThreads(1);
+
+    /// het eerste pyramide niveau moet groot genoeg zijn voor de kleinste gezichten van beide cascades
+    double max_scale = max(config.maxScale(haar[0].getOriginalWindowSize()), config.maxScale(lbp[0].getOriginalWindowSize()));
+    vector<FrameSlot> slots(pool_size);
+    for(FrameSlot &slot : slots)
+        slot.pyramid.configure(config.scale_factor, max_scale, true);
+    /// done_slots bevat elk frame hoogstens 1 keer, plus het einde van de video (-1)
+    BoundedQueue<int> free_slots(pool_size), done_slots(pool_size + 1);
+    BoundedQueue<DetectTask> tasks(2 * pool_size);
+    MotionGate gate(motion / 100.0);
+    atomic<bool> stop(false);
+    atomic<int> workers_alive(num_workers);
+    atomic<long> num_decoded(0);
+    for(int i = 0; i < pool_size; i++)
+        free_slots.push(i);
+
+    /** Decoder stage */
+    thread decoder([&]()
+    {
+        long index = 0;
+        int slot;
+        while(!stop && free_slots.pop(slot))
         {
-            char score[8];
-            for(size_t i = 0; i < faces_haar.size(); i++)
+            FrameSlot &s = slots[slot];
+            s.t_decode = StageStats::Clock::now();
+            if(!readVideoFrame(cap, s.frame, stats))
+                break;
+            s.pyramid.setFrame(s.frame);
+            s.keyframe = track_interval == 0 || index % track_interval == 0;
+            s.index = index++;
+            s.region = Rect(0, 0, s.frame.cols, s.frame.rows);
+            s.reuse = motion > 0 && !gate.update(s.frame, s.region);
+            s.config = config;
+            if(s.region != Rect(0, 0, s.frame.cols, s.frame.rows))
+            {
+                /// enkel het bewegende gebied scannen, binnen de ROI van de gebruiker
+                s.config.roi = config.roi.empty() ? s.region : (config.roi & s.region);
+                if(s.config.roi.empty())
+                    s.reuse = true;
+            }
+            if(s.reuse || !s.keyframe)
             {
-                sprintf(score, "%d", num_detections_haar[i]);
-                Point tp(faces_haar[i].x + faces_haar[i].width, faces_haar[i].y);
-                rectangle(frame_output, faces_haar[i], Scalar(0, 255, 0), 3);
-                putText(frame_output, score, tp, FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 255, 0),  1);
+                /// stilstaande en gevolgde frames gaan rechtstreeks naar de renderer
+                s.keyframe = false;
+                s.pending = 0;
+                stats.record(STAGE_DECODE, s.t_decode);
+                done_slots.push(slot);
+                continue;
             }
+            stats.record(STAGE_DECODE, s.t_decode);
+            /// bij 2-staps detectie doet de LBP taak ook de HAAR controle
+            slots[slot].pending = two_stage ? 1 : 2;
+            if(!two_stage)
+                tasks.push({slot, DETECTOR_HAAR});
+            tasks.push({slot, DETECTOR_LBP});
+        }
+        /// de renderer kan nog frames terugsturen naar de workers, hij sluit de taken queue pas na het laatste frame
+        num_decoded = index;
+        done_slots.push(-1);
+    });
 
-            for(size_t i = 0; i < faces_lbp.size(); i++)
+    /** Detector stage */
+    vector<thread> workers;
+    for(int w = 0; w < num_workers; w++)
+    {
+        workers.emplace_back([&, w]()
+        {
+            DetectTask task;
+            while(tasks.pop(task))
             {
-                sprintf(score, "%d", num_detections_lbp[i]);
-                Point tp(faces_lbp[i].x + faces_lbp[i].width, faces_lbp[i].y + faces_lbp[i].height);
-                Point cp(faces_lbp[i].x + faces_lbp[i].width / 2, faces_lbp[i].y + faces_lbp[i].height / 2 );
-                circle(frame_output, cp, max(faces_lbp[i].width / 2, faces_lbp[i].height / 2), Scalar(255, 0, 0), 3);
-                putText(frame_output, score, tp, FONT_HERSHEY_SIMPLEX, 1.0, Scalar(255, 0, 0),  1);
+                FrameSlot &slot = slots[task.slot];
+                detectFaces(haar[w], lbp[w], task.detector, two_stage, slot, stats);
+                /// de worker die de laatste taak van een frame afwerkt, geeft het frame door aan de renderer
+                if(--slot.pending == 0)
+                    done_slots.push(task.slot);
+            }
+            if(--workers_alive == 0)
+                done_slots.close();
+        });
+    }
 
+    /** Render stage: frames komen in willekeurige volgorde binnen en worden in volgorde van index verwerkt.
+     *  Er zijn nooit meer dan pool_size frames onderweg, dus frame i kan wachten op plaats i % pool_size. */
+    if(!headless)
+        namedWindow("output");
+    vector<int> reorder(pool_size, -1);
+    /// detecties van het vorige frame, voor de motion gate
+    vector<Rect> prev_haar, prev_lbp;
+    vector<int> prev_num_haar, prev_num_lbp;
+    long next_index = 0, end_index = -1, num_full_detections = 0;
+    int slot;
+    while(done_slots.pop(slot))
+    {
+        if(slot < 0)
+            end_index = num_decoded;
+        else if(stop)
+            stats.frameDropped();
+        else
+            reorder[slots[slot].index % pool_size] = slot;
+        while(!stop && reorder[next_index % pool_size] >= 0)
+        {
+            int ready_slot = reorder[next_index % pool_size];
+            FrameSlot &ready = slots[ready_slot];
+            if(ready.reuse)
+            {
+                ready.faces_haar = prev_haar;
+                ready.faces_lbp = prev_lbp;
+                ready.num_detections_haar = prev_num_haar;
+                ready.num_detections_lbp = prev_num_lbp;
+            }
+            else if(ready.keyframe && ready.region != Rect(0, 0, ready.frame.cols, ready.frame.rows))
+            {
+                /// buiten het gescande gebied blijven de vorige detecties staan
+                keepOutsideRegion(prev_haar, prev_num_haar, ready.region, ready.faces_haar, ready.num_detections_haar);
+                keepOutsideRegion(prev_lbp, prev_num_lbp, ready.region, ready.faces_lbp, ready.num_detections_lbp);
+            }
+            if(track_interval > 0 && !ready.reuse)
+            {
+                if(!ready.keyframe)
+                {
+                    StageStats::Clock::time_point t_track = StageStats::Clock::now();
+                    bool confident = tracker.update(ready, config);
+                    stats.record(STAGE_TRACK, t_track);
+                    if(!confident)
+                    {
+                        /// bij verlies van betrouwbaarheid wordt dit frame alsnog volledig gescand door de workers,
+                        /// het komt als keyframe terug via done_slots en tot dan wachten de volgende frames
+                        ready.keyframe = true;
+                        ready.region = Rect(0, 0, ready.frame.cols, ready.frame.rows);
+                        ready.config = config;
+                        ready.pending = two_stage ? 1 : 2;
+                        reorder[next_index % pool_size] = -1;
+                        if(!two_stage)
+                            tasks.push({ready_slot, DETECTOR_HAAR});
+                        tasks.push({ready_slot, DETECTOR_LBP});
+                        break;
+                    }
+                }
+                if(ready.keyframe)
+                    tracker.reset(ready);
+            }
+            if(ready.keyframe)
+                num_full_detections++;
+            if(motion > 0)
+            {
+                prev_haar = ready.faces_haar;
+                prev_lbp = ready.faces_lbp;
+                prev_num_haar = ready.num_detections_haar;
+                prev_num_lbp = ready.num_detections_lbp;
             }
+            StageStats::Clock::time_point t_render = StageStats::Clock::now();
+            if(two_stage)
+                fuseFaces(ready, nms > 0 ? nms : 0.3f);
+            else if(nms > 0)
+                mergeFaces(ready, nms);
+            if(detections.isOpen())
+                writeFaces(detections, ready, two_stage || nms > 0);
+            if(!headless || writer.isOpened())
+            {
+                ready.frame.copyTo(ready.frame_output);
+                drawFaces(ready.frame_output, ready, two_stage || nms > 0);
+                if(writer.isOpened())
+                    writer.write(ready.frame_output);
+                if(!headless)
+                {
+                    imshow("output", ready.frame_output);
+                    if(waitKey(1) >= 0)
+                    {
+                        stop = true;
+                        free_slots.close();
+                        tasks.close();
+                    }
+                }
+            }
+            stats.record(STAGE_RENDER, t_render);
+            stats.record(STAGE_PIPELINE, ready.t_decode);
+            stats.frameDone();
+            stats.maybeReport(stderr, stats_interval, stats_csv);
+            reorder[next_index % pool_size] = -1;
+            free_slots.push(ready_slot);
+            next_index++;
         }
-        imshow("output", frame_output);
-        if(waitKey(30) >= 0) break;
+        /// alle frames zijn getekend: de workers mogen stoppen, daarna sluit de laatste worker done_slots
+        if(next_index == end_index)
+            tasks.close();
+    }
+    /// frames die nog in de reorder buffer zaten bij het stoppen, werden nooit getoond
+    for(int r : reorder)
+    {
+        if(r >= 0)
+            stats.frameDropped();
     }
+
+    free_slots.close();
+    decoder.join();
+    for(thread &worker : workers)
+        worker.join();
+
+    writer.close();
+    stats.report(stderr, stats_csv);
+    if(writer.dropped() > 0)
+        fprintf(stderr, "Video writer dropped %ld frames\n", writer.dropped());
+    if(stats_csv)
+        fclose(stats_csv);
+    fprintf(stderr, "%d detector threads, %ld full detections, %ld static frames skipped\n",
+            num_workers, num_full_detections, gate.skipped());
     return 0;
 }
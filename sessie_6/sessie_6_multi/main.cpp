@@ -0,0 +1,256 @@
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "common/detection_writer.hpp"
+#include "common/image_pyramid.hpp"
+#include "common/stage_stats.hpp"
+#include "common/stream_scheduler.hpp"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Detectie op meerdere video's (of camera streams) tegelijk, met 1 vaste pool van worker threads.
+ *
+ * In plaats van per video een proces (met zijn eigen modellen en threads) te starten, verdeelt een StreamScheduler
+ * de frames van alle streams over de workers: elke worker neemt de volgende vrije stream (round robin), leest er
+ * 1 frame van, voert de detector uit en geeft de stream terug. Zo krijgt elke stream om beurt een frame verwerkt,
+ * heeft een stream nooit meer dan 1 frame onderweg, en schaalt de doorvoer met het aantal cores in plaats van met
+ * het aantal processen. Zijn er minder streams dan workers, dan krijgt elke worker de overige cores voor de interne
+ * threads van OpenCV, zodat ook 1 of 2 streams alle cores gebruiken.
+ *
+ * De modellen worden 1 keer ingelezen:
+ *   - person: 1 HOGDescriptor voor alle workers, detect() verandert de descriptor niet.
+ *   - face: de XML bestanden van de cascades worden 1 keer geparsed. CascadeClassifier is niet thread-safe, dus elke
+ *     worker (niet elke stream) bouwt zijn eigen classifiers uit de geparste boom.
+ * Elke worker heeft ook 1 eigen ImagePyramid, die hergebruikt wordt voor alle streams.
+ *
+ * De detecties van alle streams komen in 1 bestand, met het nummer van de stream als id.
+ *
+ * Een stream URL zonder aantal frames is een live stream (camera, RTSP): een mislukte read is daar geen einde van de
+ * stream. Na te veel slechte frames op rij wordt de stream 1 keer opnieuw geopend, pas als ook dat mislukt valt hij weg.
+ *
+ * Gebruik:
+ *   sessie_6_multi faces.mp4,faces.mp4,people.mp4 --detector=face --output=faces.json
+ */
+
+const String keys("{help h usage ? |<none>| print this message }"
+                  "{@videos        |<none>| comma separated list of video files or stream URLs}"
+                  "{detector       |face  | detector to run on every stream: face (HAAR + LBP) or person (HOG)}"
+                  "{xml_haar       |haarcascade_frontalface_alt.xml| classifier file for HAAR}"
+                  "{xml_lbp        |lbpcascade_frontalface_improved.xml| classifier file for LBP}"
+                  "{workers        |0     | number of worker threads (0 = number of CPU cores)}"
+                  "{scale          |1.1   | scale factor between pyramid levels}"
+                  "{output o       |      | write the detections of all streams as JSON lines (.json, .jsonl) or binary records (.bin)}"
+                  "{stats          |5     | print latency statistics every N seconds (0 = only at the end)}"
+                  "{stats_csv      |      | append the latency statistics to this CSV file}");
+
+/** Toestand van 1 stream, enkel de worker die de stream van de scheduler kreeg komt eraan */
+struct Stream
+{
+    String path;
+    VideoCapture cap;
+    Mat frame;
+    long index = 0;
+    /// live stream zonder einde, zie readVideoFrame()
+    bool live = false;
+};
+
+/** Detector modellen per worker, de HOG descriptor wordt gedeeld */
+struct Worker
+{
+    CascadeClassifier haar, lbp;
+    ImagePyramid pyramid;
+    /// detecties van het laatste frame, per detector
+    vector<Rect> found[2];
+    vector<int> scores[2];
+    vector<double> weights;
+};
+
+int main(int argc, char * argv[])
+{
+    CommandLineParser parser(argc, argv, keys);
+    String videos = parser.get<String>("@videos");
+    String detector = parser.get<String>("detector");
+    String path_output = parser.get<String>("output");
+    int num_workers = parser.get<int>("workers");
+    double stats_interval = parser.get<double>("stats");
+    String path_stats_csv = parser.get<String>("stats_csv");
+    DetectorConfig config;
+    config.scale_factor = parser.get<double>("scale");
+
+    if(videos.empty() || (detector != "face" && detector != "person"))
+    {
+        parser.printMessage();
+        return 1;
+    }
+    if(num_workers <= 0)
+        num_workers = max((int)thread::hardware_concurrency(), 1);
+
+    vector<String> paths;
+    stringstream list(videos);
+    String path;
+    while(getline(list, path, ','))
+    {
+        if(!path.empty())
+            paths.push_back(path);
+    }
+    if(paths.empty())
+    {
+        parser.printMessage();
+        return 1;
+    }
+    /// VideoCapture kan niet gekopieerd worden, dus alle streams in 1 keer aanmaken
+    vector<Stream> streams(paths.size());
+    for(size_t s = 0; s < streams.size(); s++)
+    {
+        streams[s].path = paths[s];
+        if(!streams[s].cap.open(paths[s]))
+        {
+            fprintf(stderr, "Cannot load video file %s\n", paths[s].c_str());
+            return 1;
+        }
+        /// bestanden zonder aantal frames eindigen bij de eerste mislukte read, URLs zonder aantal frames zijn live
+        streams[s].live = paths[s].find("://") != String::npos && streams[s].cap.get(CAP_PROP_FRAME_COUNT) <= 0;
+    }
+
+    /// modellen: 1 keer inlezen, de cascades per worker opbouwen uit de geparste XML
+    bool faces = detector == "face";
+    HOGDescriptor hog;
+    vector<Worker> workers(num_workers);
+    if(faces)
+    {
+        String model_paths[] = {parser.get<String>("xml_haar"), parser.get<String>("xml_lbp")};
+        for(int c = 0; c < 2; c++)
+        {
+            FileStorage fs(model_paths[c], FileStorage::READ);
+            if(!fs.isOpened())
+            {
+                fprintf(stderr, "Cannot load model file %s\n", model_paths[c].c_str());
+                return 1;
+            }
+            for(Worker &worker : workers)
+            {
+                CascadeClassifier &cascade = c == 0 ? worker.haar : worker.lbp;
+                if(!cascade.read(fs.getFirstTopLevelNode()))
+                {
+                    fprintf(stderr, "Cannot read model file %s\n", model_paths[c].c_str());
+                    return 1;
+                }
+            }
+        }
+        for(Worker &worker : workers)
+            worker.pyramid.configure(config.scale_factor, 1.0, true);
+    }
+    else
+    {
+        hog.setSVMDetector(HOGDescriptor::getDefaultPeopleDetector());
+        config.group_threshold = 2;
+        for(Worker &worker : workers)
+            worker.pyramid.configure(config.scale_factor, 1.0, false);
+    }
+
+    DetectionWriter detections;
+    mutex output_lock;
+    if(!path_output.empty() && !detections.open(path_output, faces ? vector<string>{"face_haar", "face_lbp"} : vector<string>{"person"}))
+    {
+        fprintf(stderr, "Cannot open output file %s\n", path_output.c_str());
+        return 1;
+    }
+
+    enum Stage { STAGE_DECODE, STAGE_DETECT, STAGE_WRITE };
+    StageStats stats({"decode", "detect", "write"});
+    mutex stats_lock;
+    FILE *stats_csv = nullptr;
+    if(!path_stats_csv.empty())
+    {
+        stats_csv = StageStats::openCsv(path_stats_csv);
+        if(!stats_csv)
+        {
+            fprintf(stderr, "Cannot open statistics file %s\n", path_stats_csv.c_str());
+            return 1;
+        }
+    }
+
+    /// de workers verdelen het werk zelf over de cores. Een stream heeft maar 1 frame onderweg, dus met minder
+    /// streams dan workers zijn er maar zoveel workers bezig als streams: de overige cores gaan dan naar de
+    /// interne threads van OpenCV (detectMultiScale verdeelt de schalen van 1 frame over de cores)
+    setNumThreads(max(1, num_workers / (int)streams.size()));
+
+    StreamScheduler scheduler(streams.size());
+    vector<thread> threads;
+    for(int w = 0; w < num_workers; w++)
+    {
+        threads.emplace_back([&, w]()
+        {
+            Worker &worker = workers[w];
+            size_t s;
+            while(scheduler.acquire(s))
+            {
+                Stream &stream = streams[s];
+                StageStats::Clock::time_point t_decode = StageStats::Clock::now();
+                bool read = readVideoFrame(stream.cap, stream.frame, stats, 25, stream.live);
+                if(!read && stream.live)
+                {
+                    /// verbinding verloren: 1 keer opnieuw verbinden voor de stream opgegeven wordt
+                    fprintf(stderr, "Reopening stream %zu (%s)\n", s, stream.path.c_str());
+                    stream.cap.release();
+                    read = stream.cap.open(stream.path) && readVideoFrame(stream.cap, stream.frame, stats, 25, true);
+                }
+                if(!read)
+                {
+                    scheduler.release(s, true);
+                    continue;
+                }
+                stats.record(STAGE_DECODE, t_decode);
+
+                StageStats::Clock::time_point t_detect = StageStats::Clock::now();
+                worker.pyramid.setFrame(stream.frame);
+                vector<Rect> *found = worker.found;
+                vector<int> *scores = worker.scores;
+                if(faces)
+                {
+                    detectCascade(worker.haar, worker.pyramid, config, found[0], scores[0]);
+                    detectCascade(worker.lbp, worker.pyramid, config, found[1], scores[1]);
+                }
+                else
+                {
+                    detectHog(hog, worker.pyramid, config, found[0], worker.weights);
+                }
+                stats.record(STAGE_DETECT, t_detect);
+
+                StageStats::Clock::time_point t_write = StageStats::Clock::now();
+                if(detections.isOpen())
+                {
+                    lock_guard<mutex> lock(output_lock);
+                    for(int d = 0; d < (faces ? 2 : 1); d++)
+                        for(size_t i = 0; i < found[d].size(); i++)
+                        {
+                            float score = faces ? (float)scores[d][i] : (float)worker.weights[i];
+                            detections.write(Detection(stream.index, d, found[d][i], score, (int)s));
+                        }
+                }
+                stats.record(STAGE_WRITE, t_write);
+                stream.index++;
+                stats.frameDone();
+                scheduler.release(s, false);
+                {
+                    lock_guard<mutex> lock(stats_lock);
+                    stats.maybeReport(stderr, stats_interval, stats_csv);
+                }
+            }
+        });
+    }
+    for(thread &t : threads)
+        t.join();
+
+    stats.report(stderr, stats_csv);
+    if(stats_csv)
+        fclose(stats_csv);
+    for(size_t s = 0; s < streams.size(); s++)
+        fprintf(stderr, "stream %zu (%s): %ld frames\n", s, streams[s].path.c_str(), streams[s].index);
+    fprintf(stderr, "%zu streams on %d worker threads\n", streams.size(), num_workers);
+    return 0;
+}
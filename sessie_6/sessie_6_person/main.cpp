@@ -1,5 +1,11 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "common/batch_hog_detector.hpp"
+#include "common/detection_writer.hpp"
+#include "common/frame_sink.hpp"
+#include "common/motion_gate.hpp"
+#include "common/stage_stats.hpp"
+#include "common/multi_target_tracker.hpp"
 
 using namespace std;
 using namespace cv;
@@ -10,15 +16,48 @@ using namespace cv;
                 ::setSVMDetector()
                 ::detectMultiScale
 
-   - Tracking vector: vector<Point>
-   - Resize afbeelding eerst met factor 2 om detector beter te doen werken
-   - tracking lijn tekenen door over vector<Point> te loopen en lijn te tekenen
+   - Tracking: MultiTargetTracker koppelt de detecties van opeenvolgende frames (IoU + Hongaarse methode) en geeft
+     elke persoon een ID. Per persoon worden enkel de laatste --history posities bijgehouden (ring buffer), en een
+     persoon die --max_idle frames niet meer gedetecteerd werd, verdwijnt. Geheugen en tekenwerk per frame blijven
+     zo constant, ook bij dagenlange live beelden.
+   - Kleine personen vragen een vergroting van de afbeelding (vroeger: resize met factor 2).
+     De detector draait nu op een ImagePyramid: enkel de niveaus die nodig zijn voor --min_height worden
+     berekend, en upscaling gebeurt dus enkel voor de niveaus die groter zijn dan het frame.
+   - Detectie gebeurt per batch van --batch frames met BatchHogDetector: alle niveaus van alle frames in de batch
+     worden in stroken verdeeld en samen over de cores verspreid.
+   - Motion gate (--motion=P): elk frame wordt eerst vergeleken met een achtergrondmodel. Stilstaande frames
+     worden niet gescand en hergebruiken de vorige detecties, bewegende frames worden enkel gescand rond de
+     veranderde pixels. Op vaste camera's valt zo het grootste deel van het HOG werk weg.
+   - Latency per stage (StageStats): elke --stats seconden en op het einde van de video worden p50/p95/p99 van
+     decode, detectie (per batch), tracking en tekenen getoond, samen met frames per seconde en het aantal lege
+     frames. Met --stats_csv worden ze ook achteraan een CSV bestand toegevoegd.
+   - Met --detections worden de gevolgde personen per frame weggeschreven als detectie records (JSON regels, of
+     binair voor een .bin bestand), met het track ID als id en het HOG gewicht van de detectie als score.
+   - Output (FrameSink): het resultaat wordt getoond zonder het tempo van de video op te leggen (waitKey(1) in plaats
+     van waitKey(30)), met --output in een aparte thread naar een video bestand geschreven (--skip: frames overslaan
+     wanneer de encoder niet volgt), of met --headless weggegooid om enkel de detectie te meten.
+   - tracking lijn tekenen door per track over de ring buffer te loopen en lijn te tekenen
      met line() tss 2 opeenvolgende punten
 
  */
 
  const String keys("{help h usage ? |<none>| print this message }"
-                  "{@video         |<none>| video test file}");
+                  "{@video         |<none>| video test file}"
+                  "{scale          |1.05  | scale factor between pyramid levels}"
+                  "{min_height     |64    | smallest person height in pixels (64 = old 2x upscale, 128 = no upscale)}"
+                  "{max_height     |0     | largest person height in pixels (0 = no limit)}"
+                  "{roi            |      | mask image (white = detect) restricting detection to a part of the frame}"
+                  "{iou            |0.3   | minimum overlap (IoU) to link a detection to a track}"
+                  "{max_idle       |30    | number of frames a track survives without detection}"
+                  "{history        |64    | number of trajectory points kept per track}"
+                  "{batch          |1     | number of frames detected together}"
+                  "{motion         |0     | motion gate: minimum percentage of changed pixels to run the detector (0 = off)}"
+                  "{stats          |5     | print latency statistics every N seconds (0 = only at the end)}"
+                  "{stats_csv      |      | append the latency statistics to this CSV file}"
+                  "{detections     |      | write the tracked persons as JSON lines (.json, .jsonl) or binary records (.bin) to this file}"
+                  "{output o       |      | write the annotated video to this file (.avi, .mp4) instead of showing it}"
+                  "{skip           |      | drop frames when the video writer cannot keep up}"
+                  "{headless       |      | do not display or write the result, to measure the detection speed}");
 
 
 
@@ -45,38 +84,201 @@ int main(int argc, char * argv[])
     HOGDescriptor hog;
     hog.setSVMDetector(HOGDescriptor::getDefaultPeopleDetector());
 
+    /// detector configuratie: schaalstap, min/max grootte (in verhouding tot het HOG venster) en optioneel ROI
+    DetectorConfig config;
+    config.scale_factor = parser.get<double>("scale");
+    config.group_threshold = 2;
+    int min_height = parser.get<int>("min_height"), max_height = parser.get<int>("max_height");
+    if(min_height > 0)
+        config.min_size = Size(min_height * hog.winSize.width / hog.winSize.height, min_height);
+    if(max_height > 0)
+        config.max_size = Size(max_height * hog.winSize.width / hog.winSize.height, max_height);
+    String path_roi = parser.get<String>("roi");
+    config.setRoiMask(loadRoiMask(path_roi, Size((int)cap.get(CAP_PROP_FRAME_WIDTH), (int)cap.get(CAP_PROP_FRAME_HEIGHT))));
+    if(!path_roi.empty() && config.roi_mask.empty())
+    {
+        fprintf(stderr, "Cannot load roi mask %s\n", path_roi.c_str());
+        return 1;
+    }
+    BatchHogDetector detector(hog, config, 0, Size(8,8), Size(32,32));
+
+    DetectionWriter detections;
+    String path_detections = parser.get<String>("detections");
+    if(!path_detections.empty() && !detections.open(path_detections, {"person"}))
+    {
+        fprintf(stderr, "Cannot open detections file %s\n", path_detections.c_str());
+        return 1;
+    }
+
+    /// output: video bestand (asynchroon), venster of niets
+    unique_ptr<FrameSink> sink;
+    String path_output = parser.get<String>("output");
+    if(!path_output.empty())
+    {
+        AsyncVideoSink *video = new AsyncVideoSink();
+        sink.reset(video);
+        if(!video->open(path_output, VideoWriter::fourcc('M', 'J', 'P', 'G'), cap.get(CAP_PROP_FPS),
+                        Size((int)cap.get(CAP_PROP_FRAME_WIDTH), (int)cap.get(CAP_PROP_FRAME_HEIGHT)), 8, parser.has("skip")))
+        {
+            fprintf(stderr, "Cannot open output file %s\n", path_output.c_str());
+            return 1;
+        }
+    }
+    else if(parser.has("headless"))
+        sink.reset(new NullSink());
+    else
+        sink.reset(new WindowSink("persion detection result"));
+
+    enum Stage { STAGE_DECODE, STAGE_GATE, STAGE_DETECT, STAGE_TRACK, STAGE_RENDER };
+    StageStats stats({"decode", "gate", "detect", "track", "render"});
+    double stats_interval = parser.get<double>("stats");
+    String path_stats_csv = parser.get<String>("stats_csv");
+    FILE *stats_csv = nullptr;
+    if(!path_stats_csv.empty())
+    {
+        stats_csv = StageStats::openCsv(path_stats_csv);
+        if(!stats_csv)
+        {
+            fprintf(stderr, "Cannot open statistics file %s\n", path_stats_csv.c_str());
+            return 1;
+        }
+    }
 
-    Mat frame;
-    vector<Point> track;
-    for(;;)
+
+    vector<Mat> batch(max(parser.get<int>("batch"), 1));
+    vector<vector<Rect> > batch_persons;
+    vector<vector<double> > batch_weights;
+    MultiTargetTracker tracker(parser.get<double>("iou"), parser.get<int>("max_idle"), (size_t)max(parser.get<int>("history"), 1));
+    double motion = parser.get<double>("motion");
+    MotionGate gate(motion / 100.0);
+    /// enkel de bewegende frames van een batch gaan naar de detector, met het gebied dat gescand moet worden
+    vector<Mat> moving;
+    vector<Rect> regions;
+    vector<int> moving_index(batch.size());
+    vector<vector<Rect> > moving_persons;
+    vector<vector<double> > moving_weights;
+    Mat frame_output;
+    vector<Rect> prev_persons;
+    vector<double> prev_weights;
+    long frame_index = 0;
+    bool quit = false;
+    while(!quit)
     {
-        cap >> frame;
-        resize(frame, frame, Size(frame.cols*2, frame.rows*2));
-        Mat frame_output = frame.clone();
-        vector<Rect> persons;
-
-        hog.detectMultiScale(frame, persons, 0, Size(8,8), Size(32,32), 1.05, 2, false);
-        /// Rectangle rond gedetecteerde persoon/personen tekenen
-        for (vector<Rect>::iterator i = persons.begin(); i != persons.end(); ++i)
+        /// batch inlezen, bij het einde van de video wordt de laatste batch ingekort
+        size_t n = 0;
+        while(n < batch.size())
+        {
+            StageStats::Clock::time_point t_decode = StageStats::Clock::now();
+            if(!readVideoFrame(cap, batch[n], stats))
+                break;
+            stats.record(STAGE_DECODE, t_decode);
+            n++;
+        }
+        if(n == 0)
+            break;
+        if(n < batch.size())
         {
-            Rect &r = *i;
-            Point track_point(r.tl().x + r.width/2, r.tl().y + r.height/2);
-            track.push_back(track_point);
-            rectangle(frame_output, r.tl(), r.br(), cv::Scalar(0, 255, 0), 2);
+            batch.resize(n);
+            quit = true;
         }
 
-        /// tracking lijn tekenen
-        for(int i = 0; i < track.size(); i++)
+        StageStats::Clock::time_point t_detect = StageStats::Clock::now();
+        if(motion > 0)
         {
-            if(i > 0 && norm(track[i]-track[i-1]) < 10)
+            moving.clear();
+            regions.clear();
+            for(size_t f = 0; f < batch.size(); f++)
+            {
+                Rect region;
+                moving_index[f] = -1;
+                StageStats::Clock::time_point t_gate = StageStats::Clock::now();
+                bool moved = gate.update(batch[f], region);
+                stats.record(STAGE_GATE, t_gate);
+                if(!moved)
+                    continue;
+                moving_index[f] = (int)moving.size();
+                moving.push_back(batch[f]);
+                regions.push_back(region == Rect(0, 0, batch[f].cols, batch[f].rows) ? Rect() : region);
+            }
+            detector.detect(moving, regions, moving_persons, moving_weights);
+        }
+        else
+        {
+            detector.detect(batch, batch_persons, batch_weights);
+        }
+        stats.record(STAGE_DETECT, t_detect);
+        batch_persons.resize(batch.size());
+        batch_weights.resize(batch.size());
+        for(size_t f = 0; f < batch.size(); f++)
+        {
+            if(motion > 0)
+            {
+                /// stilstaande frames: vorige detecties, gedeeltelijk gescande frames: vorige detecties buiten het gebied
+                int m = moving_index[f];
+                if(m < 0)
+                {
+                    batch_persons[f] = prev_persons;
+                    batch_weights[f] = prev_weights;
+                }
+                else
+                {
+                    batch_persons[f].swap(moving_persons[m]);
+                    batch_weights[f].swap(moving_weights[m]);
+                    if(!regions[m].empty())
+                        keepOutsideRegion(prev_persons, prev_weights, regions[m], batch_persons[f], batch_weights[f]);
+                }
+                prev_persons = batch_persons[f];
+                prev_weights = batch_weights[f];
+            }
+            StageStats::Clock::time_point t_track = StageStats::Clock::now();
+            tracker.update(batch_persons[f], batch_weights[f]);
+            stats.record(STAGE_TRACK, t_track);
+            StageStats::Clock::time_point t_render = StageStats::Clock::now();
+            bool draw = sink->needsFrames();
+            if(draw)
+                batch[f].copyTo(frame_output);
+            for(const MultiTargetTracker::Track &track : tracker.getTracks())
+            {
+                if(!track.alive)
+                    continue;
+                /// Rectangle + ID rond persoon tekenen, enkel als die in dit frame gedetecteerd werd
+                if(track.idle == 0)
+                {
+                    if(draw)
+                    {
+                        rectangle(frame_output, track.box.tl(), track.box.br(), cv::Scalar(0, 255, 0), 2);
+                        putText(frame_output, to_string(track.id), track.box.tl(), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0, 255, 0), 1);
+                    }
+                    detections.write(Detection(frame_index, 0, track.box, (float)track.score, (int)track.id));
+                }
+                /// tracking lijn tekenen
+                for(size_t i = 1; draw && i < track.history.size(); i++)
+                    line(frame_output, track.history[i], track.history[i-1], Scalar(0, 0, 255));
+            }
+            bool keep_going = sink->write(frame_output);
+            stats.record(STAGE_RENDER, t_render);
+            stats.frameDone();
+            frame_index++;
+            stats.maybeReport(stderr, stats_interval, stats_csv);
+            if(!keep_going)
             {
-                line(frame_output, track[i], track[i-1], Scalar(0, 0, 255));
+                /// de rest van de batch wordt niet meer getoond
+                for(size_t d = f + 1; d < batch.size(); d++)
+                    stats.frameDropped();
+                quit = true;
+                break;
             }
         }
-        imshow("persion detection result", frame_output);
-        if(waitKey(30) >= 0) break;
     }
 
+    sink->close();
+    stats.report(stderr, stats_csv);
+    if(sink->dropped() > 0)
+        fprintf(stderr, "Video writer dropped %ld frames\n", sink->dropped());
+    if(stats_csv)
+        fclose(stats_csv);
+    if(motion > 0)
+        fprintf(stderr, "Motion gate skipped %ld static frames\n", gate.skipped());
     return 0;
 }
 